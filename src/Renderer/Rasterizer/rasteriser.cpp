@@ -1,5 +1,6 @@
 #include "../../include/rasteriser.h"
 #include "../../image/PNGLoader.h"
+#include "../../include/texture_manager.h"
 #include "../../maths/vec.hpp"
 
 #include "../../utils/thread_pool.h"
@@ -13,7 +14,6 @@
 static thread_local RenderDevice                Device;
 
 extern Parallel::ParallelRenderer &get_current_parallel_renderer();
-extern ThreadPool                 &get_current_thread_pool();
 
 void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, Vec4f attribB, Vec4f attribC, Vec2f texA,
                 Vec2f texB, Vec2f texC)
@@ -151,7 +151,11 @@ void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, V
     }
     else if (Device.Context.ActiveMergeMode == RenderDevice::MergeMode::TEXTURE_MODE)
     {
-        auto texture = Device.Context.GetActiveTexture();
+        // Texels may only be read while pinned, an evicted or released texture is skipped
+        auto handle  = Device.Context.GetActiveTextureID();
+        auto texture = GetTextureManager().Pin(handle);
+        if (!texture)
+            return;
         for (int h = minY; h <= maxY; ++h)
         {
             int32_t offset =
@@ -175,7 +179,7 @@ void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, V
                     l3       = static_cast<float>(a1) / area;
 
                     auto uv  = l1 * texA + l2 * texB + l3 * texC;
-                    auto rgb = texture.Sample(Vec2(uv), Texture::Interpolation::NEAREST);
+                    auto rgb = texture->Sample(Vec2(uv), Texture::Interpolation::NEAREST);
                     mem[0]   = rgb.z;
                     mem[1]   = rgb.y;
                     mem[2]   = rgb.x;
@@ -190,10 +194,15 @@ void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, V
             a2_ = a2_ - v1.x;
             a3_ = a3_ - v2.x;
         }
+        GetTextureManager().Unpin(handle);
     }
     else if (Device.Context.ActiveMergeMode == RenderDevice::MergeMode::TEXTURE_BLENDING_MODE)
     {
-        auto texture = Device.Context.GetActiveTexture();
+        // Texels may only be read while pinned, an evicted or released texture is skipped
+        auto handle  = Device.Context.GetActiveTextureID();
+        auto texture = GetTextureManager().Pin(handle);
+        if (!texture)
+            return;
         for (int h = minY; h <= maxY; ++h)
         {
             int32_t offset =
@@ -217,7 +226,7 @@ void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, V
                     l3          = static_cast<float>(a1) / area;
 
                     auto  uv    = l1 * texA + l2 * texB + l3 * texC;
-                    auto  rgb   = texture.Sample(Vec2(uv), Texture::Interpolation::NEAREST);
+                    auto  rgb   = texture->Sample(Vec2(uv), Texture::Interpolation::NEAREST);
 
                     Vec4f src   = l1 * attribA + l2 * attribB + l3 * attribC;
                     src         = Vec4f(rgb * 1.0f / 255.0f, src.w);
@@ -243,6 +252,7 @@ void Rasteriser(int x1, int y1, int x2, int y2, int x3, int y3, Vec4f attribA, V
             a2_ = a2_ - v1.x;
             a3_ = a3_ - v2.x;
         }
+        GetTextureManager().Unpin(handle);
     }
 }
 
@@ -446,6 +456,16 @@ void RenderDevice::CTX::SetMergeMode(MergeMode mode)
     ActiveMergeMode = mode;
 }
 
+void RenderDevice::CTX::SetFrameUniforms(RLights const &light, Vec3f const &cameraPos)
+{
+    Uniforms.light          = light;
+    Uniforms.cameraPos      = cameraPos;
+    // Orthographic light covering the 10 x 10 field around the origin, looking at it from the light position
+    auto lightOrtho         = OrthoProjection(-5.0f, 5.0f, -5.0f, 5.0f, -5.0f, 5.0f);
+    auto lightView          = ::lookAtMatrix(light.position, Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+    Uniforms.lightTransform = lightOrtho * lightView;
+}
+
 void BresenhamLineRasteriser(Pipeline2D::VertexAttrib2D const &v0, Pipeline2D::VertexAttrib2D const &v1)
 {
     // Line clipping first
@@ -942,7 +962,7 @@ void Rasteriser(int32_t x0, int32_t y0, float z0, float inv_w0, int32_t x1, int3
                     if (1)
                     {
                         // Interpolate the depth perspective correctly
-                        /*auto rgb = texture.Sample(Vec2(uv), Texture::Interpolation::NEAREST);
+                        /*auto rgb = texture->Sample(Vec2(uv), Texture::Interpolation::NEAREST);
                         depth    = z;*/
 
                         // only calculate mem now if depth test actually passed
@@ -1002,7 +1022,7 @@ void Rasteriser(int32_t x0, int32_t y0, float z0, float inv_w0, int32_t x1, int3
     //                auto &depth = platform.zBuffer.buffer[h * platform.zBuffer.width + w];
     //                if (z < depth)
     //                {
-    //                    auto rgb = texture.Sample(Vec2(uv), Texture::Interpolation::NEAREST);
+    //                    auto rgb = texture->Sample(Vec2(uv), Texture::Interpolation::NEAREST);
     //                    depth    = z;
     //                    mem[0]   = rgb.z;
     //                    mem[1]   = rgb.y;
@@ -1,6 +1,8 @@
 #include "../include/renderer.h"
 #include "../image/PNGLoader.h"
+#include "../include/texture_manager.h"
 
+#include <atomic>
 #include <cstring>
 #include <vector>
 #include <algorithm>
@@ -10,10 +12,10 @@
 
 // Some hacks for not exporting these functions to outside caller
 
-static std::vector<Texture> Textures;
-static uint32_t             ActiveTexture;
+// Textures themselves live in the texture manager, every raster thread reads the active one
+static std::atomic<uint32_t> ActiveTexture;
 
-void                        ClearColor(uint8_t r, uint8_t g, uint8_t b)
+void                         ClearColor(uint8_t r, uint8_t g, uint8_t b)
 {
     Platform platform = GetCurrentPlatform();
     uint8_t *mem      = platform.colorBuffer.buffer;
@@ -75,39 +77,35 @@ void SetBackgroundImage(std::string_view image_path)
 
 uint32_t CreateTexture(const char *img_path) // It returns handle to that texture
 {
-    Texture tex;
-    tex.raw_data = LoadPNGFromFile(img_path, &tex.width, &tex.height, &tex.channels, &tex.bit_depth);
-    if (!tex.raw_data)
-        return 0;
-    tex.bValid    = true;
-    tex.textureID = Textures.size() + 1;
-    Textures.push_back(tex);
-    return tex.textureID;
+    return GetTextureManager().Create(img_path);
 }
 
 uint32_t CreateTextureFromData(Texture &texture)
 {
-    texture.bValid = true; 
-    texture.textureID = Textures.size() + 1; 
-    Textures.push_back(texture); 
+    texture.textureID = GetTextureManager().Create(texture);
+    texture.bValid    = texture.textureID != 0;
     return texture.textureID;
 }
 
-Texture GetTexture(uint32_t textureID)
+Texture const *GetTexture(uint32_t textureID)
 {
-    assert(textureID <= Textures.size());
     assert(textureID != 0);
-    return Textures.at(textureID - 1);
+    return GetTextureManager().Lookup(textureID);
 }
 
 void SetActiveTexture(uint32_t texture)
 {
-    ActiveTexture = texture;
+    ActiveTexture.store(texture, std::memory_order_relaxed);
 }
 
-Texture GetActiveTexture()
+Texture const *GetActiveTexture()
 {
-    return Textures.at(ActiveTexture - 1);
+    return GetTexture(ActiveTexture.load(std::memory_order_relaxed));
+}
+
+uint32_t GetActiveTextureID()
+{
+    return ActiveTexture.load(std::memory_order_relaxed);
 }
 
 void ImageViewer(uint8_t *img_buffer, uint8_t *buffer, uint32_t image_width, uint32_t image_height,
@@ -198,8 +196,8 @@ void ClearDepthBuffer()
     // who said std:: algorithms are bad :D
     auto size = platform.zBuffer.width * platform.zBuffer.height; 
     std::fill(platform.zBuffer.buffer,platform.zBuffer.buffer + size, 1.0f); 
-    std::fill(platform.shadowMap.buffer, platform.shadowMap.buffer + platform.shadowMap.width * platform.zBuffer.height,
-              1.0f);
+    std::fill(platform.shadowMap.buffer,
+              platform.shadowMap.buffer + platform.shadowMap.width * platform.shadowMap.height, 1.0f);
     // std::memset(platform.zBuffer.buffer, 0, sizeof(float) * size);
 }
 // SetBackGround 
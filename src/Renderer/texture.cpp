@@ -1,10 +1,15 @@
 #include "../include/texture.hpp"
 #include "../include/renderer.h"
+#include "../utils/job_system.h"
 
-Vec3u8 Texture::Sample(Vec2f uv, Interpolation type)
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+Vec3u8 Texture::Sample(Vec2f uv, Interpolation type) const
 {
-    // ignore type for now
-    // Just sampling part
+    // Level 0 straight from raw_data, the filtered paths of the rasteriser go through Bind
     // Texture sampling is similar to that of OpenGL, not like that of DirectX
     // PNGs are loaded in top-down order PNG loader
 
@@ -29,56 +34,586 @@ Vec3u8 Texture::Sample(Vec2f uv, Interpolation type)
         y : 0 -> image_height, 1 -> 0            .. Same, no image_height row, only image_height - 1 row
     */
 
+    // Texel centers are at half integers, v goes up the image
+    float x = uv.x * this->width - 0.5f;
+    float y = (1.0f - uv.y) * this->height - 0.5f;
+
+    // Coordinate of a texel along an axis of size texels, after wrapping or clamping
+    auto address = [&](float t, uint32_t size) {
+        if (addressing == Addressing::WRAP)
+            return static_cast<uint32_t>(t - size * std::floor(t / size)) % size;
+        return static_cast<uint32_t>(std::clamp(t, 0.0f, float(size - 1)));
+    };
+    auto texel = [&](uint32_t tx, uint32_t ty) {
+        assert(raw_data != nullptr);
+        uint8_t *pixel = raw_data + (ty * this->width + tx) * this->channels;
+        // Grey, with or without alpha, repeats its first channel
+        return this->channels < 3 ? Vec3f(pixel[0], pixel[0], pixel[0]) : Vec3f(pixel[0], pixel[1], pixel[2]);
+    };
+
     if (type == Interpolation::NEAREST)
     {
+        auto color = texel(address(std::floor(x + 0.5f), this->width), address(std::floor(y + 0.5f), this->height));
+        return Vec3u8(color.x, color.y, color.z);
+    }
 
-        uint32_t xpos, ypos;
-        xpos = static_cast<int>(uv.x * (this->width - 1));
-        ypos = static_cast<int>((1 - uv.y) * (this->height - 1));
+    // LINEAR is taken as filtering in both directions too, as GL_LINEAR is
+    float fx = std::floor(x), fy = std::floor(y);
+    float tx = x - fx, ty = y - fy;
+    auto  x0     = address(fx, this->width), x1 = address(fx + 1, this->width);
+    auto  y0     = address(fy, this->height), y1 = address(fy + 1, this->height);
+    auto  top    = texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * tx;
+    auto  bottom = texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * tx;
+    auto  color  = top + (bottom - top) * ty;
+    return Vec3u8(color.x + 0.5f, color.y + 0.5f, color.z + 0.5f);
+}
 
-        // Provide pixel in order r,g,b
-        assert(raw_data != nullptr);
+void Texture::GenerateMips()
+{
+    assert(raw_data != nullptr);
+    delete[] mips;
+
+    // Box filtered chain in linear layout first, each level from the one above it
+    std::vector<std::vector<uint8_t>> linear;
+    linear.emplace_back(raw_data, raw_data + width * height * channels);
+    levels     = 0;
+    size_t end = 0;
+    for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+    {
+        auto tiles_x = (w + tile_dim - 1) / tile_dim;
+        auto tiles_y = (h + tile_dim - 1) / tile_dim;
+        mip[levels]  = MipLevel{w, h, tiles_x, end};
+        end += size_t(tiles_x) * tiles_y * tile_dim * tile_dim * channels;
+        if (levels)
+        {
+            auto const &above  = linear.back();
+            auto const &parent = mip[levels - 1];
+            // Parent texels under child texel i along one axis, weights out of 4. An even parent gives two halves, an
+            // odd one 1/4 1/2 1/4 over three texels so that its last texel still reaches the child
+            struct Footprint
+            {
+                uint32_t at[3], weight[3];
+            };
+            auto footprint = [](uint32_t size, uint32_t i) {
+                if (size > 1 && (size & 1))
+                    return Footprint{{2 * i, 2 * i + 1, 2 * i + 2}, {1, 2, 1}};
+                return Footprint{{std::min(2 * i, size - 1), std::min(2 * i + 1, size - 1), 0}, {2, 2, 0}};
+            };
+            std::vector<uint8_t> level(size_t(w) * h * channels);
+            for (uint32_t y = 0; y < h; ++y)
+            {
+                auto fy = footprint(parent.height, y);
+                for (uint32_t x = 0; x < w; ++x)
+                {
+                    auto fx = footprint(parent.width, x);
+                    for (uint32_t c = 0; c < channels; ++c)
+                    {
+                        uint32_t sum = 0;
+                        for (int j = 0; j < 3; ++j)
+                            for (int i = 0; i < 3; ++i)
+                                sum += fy.weight[j] * fx.weight[i] *
+                                       above[(fy.at[j] * parent.width + fx.at[i]) * channels + c];
+                        level[(y * w + x) * channels + c] = static_cast<uint8_t>((sum + 8) / 16);
+                    }
+                }
+            }
+            linear.push_back(std::move(level));
+        }
+        levels++;
+        if ((w == 1 && h == 1) || levels == max_levels)
+            break;
+    }
+
+    // Then swizzled into the tiled layout, padding texels of partial tiles are never read
+    // The sampler reads RGB8 texels 4 bytes at a time, the last one needs a byte past the end
+    assert(end + 1 <= INT32_MAX);
+    mips      = new uint8_t[end + 1]{};
+    mip_bytes = end + 1;
+    for (uint32_t l = 0; l < levels; ++l)
+    {
+        auto const &level = mip[l];
+        for (uint32_t y = 0; y < level.height; ++y)
+        {
+            for (uint32_t x = 0; x < level.width; ++x)
+            {
+                uint32_t morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+                size_t   tile   = (y >> tile_bits) * level.tiles_x + (x >> tile_bits);
+                std::memcpy(mips + level.offset + ((tile << (2 * tile_bits)) + morton) * channels,
+                            linear[l].data() + (y * level.width + x) * channels, channels);
+            }
+        }
+    }
+}
+
+namespace
+{
+enum class TexelFormat
+{
+    R8,
+    RA8, // grey and alpha, sampled through the grey channel
+    RGB8,
+    RGBA8
+};
+
+enum class Address
+{
+    WRAP,
+    WRAP_POW2, // every level is a power of two, wrapping is a mask
+    CLAMP
+};
+
+// Lanes of a texel coordinate after wrapping or clamping, t being floor of the filter position and size the size of
+// the level along that axis. Both the texel at t and the one after it are returned
+template <Address address> void AddressTexels(__m128 t, __m128i size, __m128i &t0, __m128i &t1)
+{
+    auto one = _mm_set1_epi32(1);
+    if constexpr (address == Address::CLAMP)
+    {
+        auto last = _mm_sub_epi32(size, one);
+        t0        = _mm_cvttps_epi32(t);
+        t1        = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(t0, one), _mm_setzero_si128()), last);
+        t0        = _mm_min_epi32(_mm_max_epi32(t0, _mm_setzero_si128()), last);
+    }
+    else if constexpr (address == Address::WRAP_POW2)
+    {
+        auto mask = _mm_sub_epi32(size, one);
+        t0        = _mm_cvttps_epi32(t);
+        t1        = _mm_and_si128(_mm_add_epi32(t0, one), mask);
+        t0        = _mm_and_si128(t0, mask);
+    }
+    else
+    {
+        // t - size * floor(t / size), in floats so that there is no integer division
+        auto fsize = _mm_cvtepi32_ps(size);
+        auto fmod  = _mm_sub_ps(t, _mm_mul_ps(fsize, _mm_floor_ps(_mm_div_ps(t, fsize))));
+        t0         = _mm_min_epi32(_mm_cvttps_epi32(fmod), _mm_sub_epi32(size, one));
+        t1         = _mm_add_epi32(t0, one);
+        t1         = _mm_andnot_si128(_mm_cmpeq_epi32(t1, size), t1);
+    }
+}
+
+// Byte offsets of texels (x, y) in the tiled layout, see Texture::GenerateMips
+template <TexelFormat format> __m128i TexelOffsets(__m128i x, __m128i y, __m128i tiles_x, __m128i offset)
+{
+    auto bit    = [](__m128i v, int32_t mask, int32_t shift) {
+        return _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(mask)), shift);
+    };
+    auto morton = _mm_or_si128(_mm_or_si128(bit(x, 1, 0), bit(y, 1, 1)), _mm_or_si128(bit(x, 2, 1), bit(y, 2, 2)));
+    auto tile   = _mm_add_epi32(_mm_mullo_epi32(_mm_srli_epi32(y, Texture::tile_bits), tiles_x),
+                                _mm_srli_epi32(x, Texture::tile_bits));
+    auto texel  = _mm_or_si128(_mm_slli_epi32(tile, 2 * Texture::tile_bits), morton);
+    if constexpr (format == TexelFormat::RA8)
+        texel = _mm_slli_epi32(texel, 1);
+    else if constexpr (format == TexelFormat::RGB8)
+        texel = _mm_add_epi32(_mm_slli_epi32(texel, 1), texel);
+    else if constexpr (format == TexelFormat::RGBA8)
+        texel = _mm_slli_epi32(texel, 2);
+    return _mm_add_epi32(texel, offset);
+}
+
+// Channels of the texels at the given byte offsets, as floats
+template <TexelFormat format> void FetchTexels(uint8_t const *texels, __m128i offsets, __m128 rgb[3])
+{
+    alignas(16) int32_t at[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(at), offsets);
+    if constexpr (format == TexelFormat::R8 || format == TexelFormat::RA8)
+    {
+        rgb[0] = _mm_cvtepi32_ps(_mm_setr_epi32(texels[at[0]], texels[at[1]], texels[at[2]], texels[at[3]]));
+        rgb[1] = rgb[2] = rgb[0];
+        return;
+    }
+    // RGB8 reads the first byte of the next texel along, it is masked out with the alpha
+    auto load   = [&](int32_t k) {
+        uint32_t texel;
+        std::memcpy(&texel, texels + at[k], sizeof(texel));
+        return static_cast<int32_t>(texel);
+    };
+    auto packed = _mm_setr_epi32(load(0), load(1), load(2), load(3));
+    auto byte   = _mm_set1_epi32(0xFF);
+    rgb[0]      = _mm_cvtepi32_ps(_mm_and_si128(packed, byte));
+    rgb[1]      = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 8), byte));
+    rgb[2]      = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 16), byte));
+}
+
+template <TexelFormat format, Address address>
+void Bilinear(TextureSampler const &s, __m128 u, __m128 v, __m128i level, __m128 rgb[3])
+{
+    alignas(16) int32_t l[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(l), level);
+    auto gather = [&](int32_t const *table) {
+        return _mm_setr_epi32(table[l[0]], table[l[1]], table[l[2]], table[l[3]]);
+    };
+    auto width   = gather(s.width);
+    auto height  = gather(s.height);
+    auto tiles_x = gather(s.tiles_x);
+    auto offset  = gather(s.offset);
+
+    auto half    = _mm_set1_ps(0.5f);
+    if constexpr (address == Address::CLAMP)
+    {
+        // Clamping the coordinates first keeps the conversions below in range
+        u = _mm_min_ps(_mm_max_ps(u, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    }
+    // Texel centers are at half integers, v goes up the image
+    auto x  = _mm_sub_ps(_mm_mul_ps(u, _mm_cvtepi32_ps(width)), half);
+    auto y  = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), v), _mm_cvtepi32_ps(height)), half);
+    auto fx = _mm_floor_ps(x);
+    auto fy = _mm_floor_ps(y);
+    auto tx = _mm_sub_ps(x, fx);
+    auto ty = _mm_sub_ps(y, fy);
+
+    __m128i x0, x1, y0, y1;
+    AddressTexels<address>(fx, width, x0, x1);
+    AddressTexels<address>(fy, height, y0, y1);
+
+    __m128 c00[3], c10[3], c01[3], c11[3];
+    FetchTexels<format>(s.texels, TexelOffsets<format>(x0, y0, tiles_x, offset), c00);
+    FetchTexels<format>(s.texels, TexelOffsets<format>(x1, y0, tiles_x, offset), c10);
+    FetchTexels<format>(s.texels, TexelOffsets<format>(x0, y1, tiles_x, offset), c01);
+    FetchTexels<format>(s.texels, TexelOffsets<format>(x1, y1, tiles_x, offset), c11);
+    constexpr bool grey     = format == TexelFormat::R8 || format == TexelFormat::RA8;
+    constexpr int  channels = grey ? 1 : 3;
+    for (int c = 0; c < channels; ++c)
+    {
+        auto top    = _mm_add_ps(c00[c], _mm_mul_ps(_mm_sub_ps(c10[c], c00[c]), tx));
+        auto bottom = _mm_add_ps(c01[c], _mm_mul_ps(_mm_sub_ps(c11[c], c01[c]), tx));
+        rgb[c]      = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ty));
+    }
+    if constexpr (grey)
+        rgb[1] = rgb[2] = rgb[0];
+}
+
+template <TexelFormat format, Address address>
+void Trilinear(TextureSampler const &s, __m128 u, __m128 v, __m128 lod, __m128 rgb[3])
+{
+    lod         = _mm_min_ps(_mm_max_ps(lod, _mm_setzero_ps()), _mm_set1_ps(float(s.levels - 1)));
+    auto level  = _mm_cvttps_epi32(lod);
+    auto blend  = _mm_sub_ps(lod, _mm_cvtepi32_ps(level));
+    Bilinear<format, address>(s, u, v, level, rgb);
+    // Magnified and exactly on a level, the next level has no weight
+    if (!_mm_movemask_ps(_mm_cmpgt_ps(blend, _mm_setzero_ps())))
+        return;
+
+    __m128 next[3];
+    auto   last = _mm_set1_epi32(s.levels - 1);
+    Bilinear<format, address>(s, u, v, _mm_min_epi32(_mm_add_epi32(level, _mm_set1_epi32(1)), last), next);
+    for (int c = 0; c < 3; ++c)
+        rgb[c] = _mm_add_ps(rgb[c], _mm_mul_ps(_mm_sub_ps(next[c], rgb[c]), blend));
+}
+
+template <TexelFormat format> TextureSampler::SampleFn SelectAddressing(Address address)
+{
+    switch (address)
+    {
+    case Address::WRAP:
+        return Trilinear<format, Address::WRAP>;
+    case Address::WRAP_POW2:
+        return Trilinear<format, Address::WRAP_POW2>;
+    case Address::CLAMP:
+        return Trilinear<format, Address::CLAMP>;
+    }
+    return nullptr;
+}
+} // namespace
 
-        uint8_t *pixel = raw_data + (ypos * this->width + xpos) * this->channels;
-        Vec3u8   pixel_color;
-        if (this->channels == 1)
-            pixel_color = Vec3u8(pixel[0]);
-        else
-            pixel_color = Vec3u8(pixel[0], pixel[1], pixel[2]);
-        return pixel_color;
+TextureSampler Texture::Bind() const
+{
+    assert(mips != nullptr);
+    TextureSampler sampler;
+    sampler.texels = mips;
+    sampler.levels = static_cast<int32_t>(levels);
+    for (uint32_t l = 0; l < levels; ++l)
+    {
+        sampler.width[l]   = static_cast<int32_t>(mip[l].width);
+        sampler.height[l]  = static_cast<int32_t>(mip[l].height);
+        sampler.tiles_x[l] = static_cast<int32_t>(mip[l].tiles_x);
+        sampler.offset[l]  = static_cast<int32_t>(mip[l].offset);
     }
 
-    // Assuming type is linear, we have
-    float32 xpos, ypos;
-    xpos = (uv.x * (this->width - 1));
-    ypos = (1 - uv.y) * (this->height - 1);
-    if ((uint32_t)xpos == this->width - 1)
+    // Halving a power of two stays a power of two down to 1x1, so the first level decides for the chain
+    bool   pow2    = !(width & (width - 1)) && !(height & (height - 1));
+    auto   address = addressing == Addressing::CLAMP ? Address::CLAMP : pow2 ? Address::WRAP_POW2 : Address::WRAP;
+    assert(channels >= 1 && channels <= 4);
+    sampler.sample = channels == 4   ? SelectAddressing<TexelFormat::RGBA8>(address)
+                     : channels == 3 ? SelectAddressing<TexelFormat::RGB8>(address)
+                     : channels == 2 ? SelectAddressing<TexelFormat::RA8>(address)
+                                     : SelectAddressing<TexelFormat::R8>(address);
+    return sampler;
+}
+
+FilterKernel Texture::Convolution::Gaussian(float sigma)
+{
+    SeparableKernel axis;
+    int32_t         radius = static_cast<int32_t>(std::ceil(3.0f * sigma));
+    if (sigma <= 0.0f)
+        return FilterKernel{.terms = 1, .term = {{1.0f, axis, axis}}};
+
+    if (radius <= SeparableKernel::max_radius)
     {
-        // return nearest neighborhood
-        uint8_t *pixel = raw_data + ((uint32_t)ypos * this->width + (uint32_t)xpos) * this->channels;
-        return Vec3u8(pixel[0], pixel[1], pixel[2]);
+        axis.radius = radius;
+        float sum   = 0.0f;
+        for (int32_t k = -radius; k <= radius; ++k)
+            sum += axis.taps[k + radius] = std::exp(-0.5f * k * k / (sigma * sigma));
+        for (int32_t k = 0; k <= 2 * radius; ++k)
+            axis.taps[k] /= sum;
     }
     else
     {
-        // Perform linear sampling
-        // Linear sampling is done along only one axis and is linear interpolation between two nearby pixels
-        uint32_t x      = static_cast<uint32_t>(xpos);
-        float32  xfrac  = xpos - x;
-        uint8_t *pixel  = raw_data + ((uint32_t)ypos * this->width + (uint32_t)xpos) * this->channels;
+        // Boxes of odd widths l and l + 2, m of the narrow ones, so that the variances ((w^2 - 1) / 12 each) add up to
+        // sigma^2 as closely as odd widths allow
+        constexpr int32_t n     = SeparableKernel::max_boxes;
+        float             ideal = std::sqrt(12.0f * sigma * sigma / n + 1.0f);
+        int32_t           l     = static_cast<int32_t>(ideal);
+        l -= !(l & 1);
+        int32_t m  = static_cast<int32_t>(
+            std::round((12.0f * sigma * sigma - n * l * l - 4.0f * n * l - 3.0f * n) / (-4.0f * l - 4.0f)));
+        axis.boxes = n;
+        for (int32_t b = 0; b < n; ++b)
+            axis.box_radius[b] = ((b < m ? l : l + 2) - 1) / 2;
+    }
+    return FilterKernel{.terms = 1, .term = {{1.0f, axis, axis}}};
+}
+
+namespace
+{
+// Planes are width * height pixels of 4 floats, row after row
+struct Plane
+{
+    __m128 *pixels;
+    int32_t width, height;
+
+    __m128 *row(int32_t y) const
+    {
+        return pixels + size_t(y) * width;
+    }
+};
+
+constexpr size_t rows_per_job = 8;
+
+void LoadPlane(uint8_t const *texels, uint32_t channels, Plane const &dst, size_t first, size_t last)
+{
+    for (size_t y = first; y < last; ++y)
+    {
+        auto src = texels + y * dst.width * channels;
+        auto out = dst.row(static_cast<int32_t>(y));
+        for (int32_t x = 0; x < dst.width; ++x, src += channels)
+        {
+            uint32_t texel = 0;
+            std::memcpy(&texel, src, channels);
+            out[x] = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(texel))));
+        }
+    }
+}
+
+// texels = centre * source + scale * src (+ sum), rounded and saturated to 8 bits
+void StorePlane(Plane const &source, float centre, Plane const &src, float scale, Plane const *sum, uint8_t *texels,
+                uint32_t channels, size_t first, size_t last)
+{
+    auto c = _mm_set1_ps(centre);
+    auto s = _mm_set1_ps(scale);
+    for (size_t y = first; y < last; ++y)
+    {
+        auto out = texels + y * src.width * channels;
+        auto in  = src.row(static_cast<int32_t>(y));
+        auto id  = source.row(static_cast<int32_t>(y));
+        auto acc = sum ? sum->row(static_cast<int32_t>(y)) : nullptr;
+        for (int32_t x = 0; x < src.width; ++x, out += channels)
+        {
+            auto value = _mm_mul_ps(s, in[x]);
+            if (centre != 0.0f)
+                value = _mm_add_ps(value, _mm_mul_ps(c, id[x]));
+            if (acc)
+                value = _mm_add_ps(value, acc[x]);
+            auto     texel  = _mm_cvtps_epi32(value);
+            texel           = _mm_packus_epi16(_mm_packs_epi32(texel, texel), texel);
+            uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(texel));
+            std::memcpy(out, &packed, channels);
+        }
+    }
+}
+
+void HorizontalTaps(Plane const &src, Plane const &dst, SeparableKernel const &k, size_t first, size_t last)
+{
+    int32_t r = k.radius, w = src.width;
+    __m128  taps[2 * SeparableKernel::max_radius + 1];
+    for (int32_t t = 0; t <= 2 * r; ++t)
+        taps[t] = _mm_set1_ps(k.taps[t]);
+
+    auto filter = [&](__m128 const *in, int32_t x, auto clamp) {
+        auto acc = _mm_setzero_ps();
+        for (int32_t t = 0; t <= 2 * r; ++t)
+            acc = _mm_add_ps(acc, _mm_mul_ps(taps[t], in[clamp(x + t - r)]));
+        return acc;
+    };
+    auto clamped = [w](int32_t x) { return std::clamp(x, 0, w - 1); };
+    auto inside  = [](int32_t x) { return x; };
+
+    for (size_t y = first; y < last; ++y)
+    {
+        auto in  = src.row(static_cast<int32_t>(y));
+        auto out = dst.row(static_cast<int32_t>(y));
+        // Only the first and last r pixels reach past the edges
+        int32_t x = 0;
+        for (; x < std::min(r, w); ++x)
+            out[x] = filter(in, x, clamped);
+        for (; x < w - r; ++x)
+            out[x] = filter(in, x, inside);
+        for (; x < w; ++x)
+            out[x] = filter(in, x, clamped);
+    }
+}
 
-        auto     cColor = Vec3u8(pixel[0], pixel[1], pixel[2]); // --> Current pixel
-        pixel           = pixel + this->channels;
+void VerticalTaps(Plane const &src, Plane const &dst, SeparableKernel const &k, size_t first, size_t last)
+{
+    int32_t       r = k.radius;
+    __m128        taps[2 * SeparableKernel::max_radius + 1];
+    __m128 const *rows[2 * SeparableKernel::max_radius + 1];
+    for (int32_t t = 0; t <= 2 * r; ++t)
+        taps[t] = _mm_set1_ps(k.taps[t]);
 
-        auto nColor     = Vec3u8(pixel[0], pixel[1], pixel[2]); // -->Next pixel on the row <-- Guarranted to exist
+    for (size_t y = first; y < last; ++y)
+    {
+        for (int32_t t = 0; t <= 2 * r; ++t)
+            rows[t] = src.row(std::clamp(static_cast<int32_t>(y) + t - r, 0, src.height - 1));
+        auto out = dst.row(static_cast<int32_t>(y));
+        for (int32_t x = 0; x < src.width; ++x)
+        {
+            auto acc = _mm_setzero_ps();
+            for (int32_t t = 0; t <= 2 * r; ++t)
+                acc = _mm_add_ps(acc, _mm_mul_ps(taps[t], rows[t][x]));
+            out[x] = acc;
+        }
+    }
+}
 
-        // auto fColor     = nColor - cColor; // <-- signed overflow/ unsigned wraparound
-        auto fColor =
-            Vec3<int16_t>((int16_t)nColor.x - cColor.x, (int16_t)nColor.y - cColor.y, (int16_t)nColor.z - cColor.z);
-        auto rColor = xfrac * fColor;
+// Running sum along the row, two adds per pixel whatever the radius
+void HorizontalBox(Plane const &src, Plane const &dst, int32_t r, size_t first, size_t last)
+{
+    int32_t w     = src.width;
+    auto    scale = _mm_set1_ps(1.0f / (2 * r + 1));
+    for (size_t y = first; y < last; ++y)
+    {
+        auto in  = src.row(static_cast<int32_t>(y));
+        auto out = dst.row(static_cast<int32_t>(y));
+        auto sum = _mm_setzero_ps();
+        for (int32_t x = -r; x <= r; ++x)
+            sum = _mm_add_ps(sum, in[std::clamp(x, 0, w - 1)]);
+        for (int32_t x = 0; x < w; ++x)
+        {
+            out[x] = _mm_mul_ps(sum, scale);
+            sum    = _mm_add_ps(sum, _mm_sub_ps(in[std::min(x + r + 1, w - 1)], in[std::max(x - r, 0)]));
+        }
+    }
+}
+
+// Running sums down a block of columns at a time, the rows of the block are read one after the other
+void VerticalBox(Plane const &src, Plane const &dst, int32_t r, size_t first, size_t last)
+{
+    constexpr int32_t block = 64;
+    int32_t           h     = src.height;
+    auto              scale = _mm_set1_ps(1.0f / (2 * r + 1));
+    __m128            sums[block];
+    for (auto x0 = static_cast<int32_t>(first); x0 < static_cast<int32_t>(last); x0 += block)
+    {
+        int32_t n = std::min(block, static_cast<int32_t>(last) - x0);
+        for (int32_t i = 0; i < n; ++i)
+            sums[i] = _mm_setzero_ps();
+        for (int32_t y = -r; y <= r; ++y)
+        {
+            auto in = src.row(std::clamp(y, 0, h - 1)) + x0;
+            for (int32_t i = 0; i < n; ++i)
+                sums[i] = _mm_add_ps(sums[i], in[i]);
+        }
+        for (int32_t y = 0; y < h; ++y)
+        {
+            auto out   = dst.row(y) + x0;
+            auto enter = src.row(std::min(y + r + 1, h - 1)) + x0;
+            auto leave = src.row(std::max(y - r, 0)) + x0;
+            for (int32_t i = 0; i < n; ++i)
+            {
+                out[i]  = _mm_mul_ps(sums[i], scale);
+                sums[i] = _mm_add_ps(sums[i], _mm_sub_ps(enter[i], leave[i]));
+            }
+        }
+    }
+}
+} // namespace
+
+void Texture::Convolve(FilterKernel const &kernel, Jobs::Scheduler &scheduler, ConvolutionScratch &scratch)
+{
+    assert(channels >= 1 && channels <= 4 && kernel.terms >= 1 && kernel.terms <= FilterKernel::max_terms);
+    auto   w = static_cast<int32_t>(width), h = static_cast<int32_t>(height);
+    size_t pixels = size_t(width) * height;
+    if (!pixels)
+        return;
+
+    // The source is read again at the end unless the kernel is a single term without a centre, it then takes part in
+    // the ping-pong
+    bool keep_source = kernel.centre != 0.0f || kernel.terms > 1;
+    auto plane       = [&](int i) {
+        if (scratch.planes[i].size() < pixels)
+            scratch.planes[i].resize(pixels);
+        return Plane{reinterpret_cast<__m128 *>(scratch.planes[i].data()), w, h};
+    };
+    Plane source  = plane(0);
+    Plane pair[2] = {keep_source ? plane(1) : source, keep_source ? plane(2) : plane(1)};
+    Plane sum     = kernel.terms > 1 ? plane(3) : Plane{};
+
+    auto rows = [&](auto pass) {
+        scheduler.parallel_for(0, height, rows_per_job, pass);
+    };
+    auto columns = [&](auto pass) {
+        scheduler.parallel_for(0, width, 64, pass);
+    };
+    rows([&](size_t first, size_t last) { LoadPlane(raw_data, channels, source, first, last); });
+
+    Plane result;
+    for (uint32_t t = 0; t < kernel.terms; ++t)
+    {
+        auto const &term = kernel.term[t];
+        Plane       cur  = source;
+        auto        next = [&] { return cur.pixels == pair[0].pixels ? pair[1] : pair[0]; };
+        if (term.x.radius || term.x.taps[0] != 1.0f)
+        {
+            auto dst = next();
+            rows([&](size_t first, size_t last) { HorizontalTaps(cur, dst, term.x, first, last); });
+            cur = dst;
+        }
+        for (int32_t b = 0; b < term.x.boxes; ++b)
+        {
+            auto dst = next();
+            rows([&](size_t first, size_t last) { HorizontalBox(cur, dst, term.x.box_radius[b], first, last); });
+            cur = dst;
+        }
+        if (term.y.radius || term.y.taps[0] != 1.0f)
+        {
+            auto dst = next();
+            rows([&](size_t first, size_t last) { VerticalTaps(cur, dst, term.y, first, last); });
+            cur = dst;
+        }
+        for (int32_t b = 0; b < term.y.boxes; ++b)
+        {
+            auto dst = next();
+            columns([&](size_t first, size_t last) { VerticalBox(cur, dst, term.y.box_radius[b], first, last); });
+            cur = dst;
+        }
 
-        return cColor + Vec3u8(rColor.x, rColor.y, rColor.z);
+        // Every term but the last is summed up, the last one is added while storing
+        if (t + 1 < kernel.terms)
+        {
+            auto scale = _mm_set1_ps(term.scale);
+            rows([&](size_t first, size_t last) {
+                for (size_t i = first * width; i < last * width; ++i)
+                    sum.pixels[i] = _mm_add_ps(t ? sum.pixels[i] : _mm_setzero_ps(), _mm_mul_ps(scale, cur.pixels[i]));
+            });
+        }
+        result = cur;
     }
 
-    // Bilinear sampling .. next time
-    return {};
+    float scale = kernel.term[kernel.terms - 1].scale;
+    rows([&](size_t first, size_t last) {
+        StorePlane(source, kernel.centre, result, scale, kernel.terms > 1 ? &sum : nullptr, raw_data, channels, first,
+                   last);
+    });
 }
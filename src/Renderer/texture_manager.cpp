@@ -0,0 +1,267 @@
+#include "../include/texture_manager.h"
+
+#include <cassert>
+#include <cstdlib>
+
+TextureManager::TextureManager(size_t budget) : budget{budget}
+{
+}
+
+TextureManager::~TextureManager()
+{
+    for (uint32_t index = 1; index < slots; ++index)
+    {
+        auto &s = chunks[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)];
+        if (s.alive)
+            destroy(s);
+    }
+}
+
+TextureManager::Slot *TextureManager::slot(Handle handle) const
+{
+    uint32_t index = handle & index_mask;
+    if (!index || (index >> chunk_bits) >= max_chunks)
+        return nullptr;
+    auto chunk = chunks[index >> chunk_bits].load(std::memory_order_acquire);
+    if (!chunk)
+        return nullptr;
+    auto &s = chunk[index & (chunk_size - 1)];
+    // Released handles carry an older generation
+    if (s.generation.load(std::memory_order_acquire) != handle >> index_bits)
+        return nullptr;
+    return &s;
+}
+
+// Called with the lock held
+TextureManager::Handle TextureManager::insert(Texture const &texture, std::string path)
+{
+    uint32_t index;
+    if (!free_slots.empty())
+    {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    else
+    {
+        index = slots;
+        if ((index >> chunk_bits) >= max_chunks)
+            return 0;
+        if (!(index & (chunk_size - 1)) || index == 1)
+        {
+            storage.push_back(std::make_unique<Slot[]>(chunk_size));
+            chunks[index >> chunk_bits].store(storage.back().get(), std::memory_order_release);
+        }
+        slots++;
+        chunks[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)].index = index;
+    }
+
+    auto &s      = chunks[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)];
+    s.texture    = texture;
+    s.path       = std::move(path);
+    s.alive      = true;
+    s.resident   = true;
+    s.references = 1;
+    s.pins       = 0;
+    s.last_used  = ++clock;
+    s.bytes      = size_t(texture.width) * texture.height * texture.channels + texture.mip_bytes;
+
+    auto handle         = index | (s.generation.load(std::memory_order_relaxed) << index_bits);
+    s.texture.textureID = handle;
+    s.texture.bValid    = true;
+    resident_bytes += s.bytes;
+    textures++;
+    resident++;
+    return handle;
+}
+
+TextureManager::Handle TextureManager::Create(const char *path)
+{
+    // Decoding happens outside the lock, other threads keep creating and pinning meanwhile
+    Texture texture;
+    texture.raw_data = LoadPNGFromFile(path, &texture.width, &texture.height, &texture.channels, &texture.bit_depth);
+    if (!texture.raw_data)
+        return 0;
+    texture.GenerateMips();
+
+    std::scoped_lock guard(lock);
+    auto             handle = insert(texture, path);
+    if (!handle)
+    {
+        std::free(texture.raw_data);
+        delete[] texture.mips;
+        return 0;
+    }
+    enforce_budget();
+    return handle;
+}
+
+TextureManager::Handle TextureManager::Create(Texture const &texture)
+{
+    Texture copy = texture;
+    copy.mips    = nullptr;
+    copy.GenerateMips();
+
+    std::scoped_lock guard(lock);
+    auto             handle = insert(copy, {});
+    if (!handle)
+    {
+        delete[] copy.mips;
+        return 0;
+    }
+    enforce_budget();
+    return handle;
+}
+
+void TextureManager::Retain(Handle handle)
+{
+    std::scoped_lock guard(lock);
+    if (auto s = slot(handle))
+        s->references++;
+}
+
+void TextureManager::Release(Handle handle)
+{
+    std::scoped_lock guard(lock);
+    auto             s = slot(handle);
+    if (!s || !s->references)
+        return;
+    if (!--s->references && !s->pins)
+        destroy(*s);
+}
+
+Texture const *TextureManager::Pin(Handle handle)
+{
+    std::scoped_lock guard(lock);
+    auto             s = slot(handle);
+    if (!s || !s->references)
+        return nullptr;
+
+    // Reloading holds the lock, it only happens after the texture was evicted for being over the budget
+    if (!s->resident)
+    {
+        auto &t    = s->texture;
+        t.raw_data = LoadPNGFromFile(s->path.c_str(), &t.width, &t.height, &t.channels, &t.bit_depth);
+        if (!t.raw_data)
+            return nullptr;
+        t.mips = nullptr;
+        t.GenerateMips();
+        s->resident = true;
+        s->bytes    = size_t(t.width) * t.height * t.channels + t.mip_bytes;
+        resident_bytes += s->bytes;
+        resident++;
+        reloads++;
+    }
+    s->pins++;
+    s->last_used = ++clock;
+    enforce_budget();
+    return &s->texture;
+}
+
+void TextureManager::Unpin(Handle handle)
+{
+    std::scoped_lock guard(lock);
+    auto             s = slot(handle);
+    if (!s || !s->pins)
+        return;
+    s->pins--;
+    if (!s->pins && !s->references)
+        destroy(*s);
+    else if (!s->pins)
+        enforce_budget();
+}
+
+Texture const *TextureManager::Lookup(Handle handle) const
+{
+    auto s = slot(handle);
+    return s ? &s->texture : nullptr;
+}
+
+void TextureManager::SetBudget(size_t bytes)
+{
+    std::scoped_lock guard(lock);
+    budget = bytes;
+    enforce_budget();
+}
+
+TextureManager::Statistics TextureManager::GetStatistics() const
+{
+    std::scoped_lock guard(lock);
+    return Statistics{resident_bytes, budget, textures, resident, evictions, reloads, retired};
+}
+
+// Called with the lock held, drops the texels but keeps the description of the texture
+void TextureManager::evict(Slot &s)
+{
+    assert(s.resident && !s.pins && !s.path.empty());
+    std::free(s.texture.raw_data);
+    delete[] s.texture.mips;
+    s.texture.raw_data = nullptr;
+    s.texture.mips     = nullptr;
+    s.resident         = false;
+    resident_bytes -= s.bytes;
+    resident--;
+    evictions++;
+}
+
+// Called with the lock held
+void TextureManager::destroy(Slot &s)
+{
+    if (s.resident)
+    {
+        // Memory textures only lend their raw_data
+        if (!s.path.empty())
+            std::free(s.texture.raw_data);
+        delete[] s.texture.mips;
+        resident_bytes -= s.bytes;
+        resident--;
+    }
+    s.texture = Texture{};
+    s.path.clear();
+    s.alive    = false;
+    s.resident = false;
+    textures--;
+    // Outstanding handles stop resolving before the slot is handed out again
+    // A slot whose generation ran out is retired for good, wrapping around would revive the oldest handles. Its
+    // generation is left past max_generation, no handle can carry that
+    auto generation = s.generation.load(std::memory_order_relaxed) + 1;
+    s.generation.store(generation, std::memory_order_release);
+    if (generation <= max_generation)
+        free_slots.push_back(s.index);
+    else
+        retired++;
+}
+
+// Called with the lock held, evicts the least recently pinned textures until the resident ones fit
+// A linear scan, it only runs when a texture is created, pinned or unpinned and the budget is exceeded
+void TextureManager::enforce_budget()
+{
+    while (resident_bytes > budget)
+    {
+        Slot *victim = nullptr;
+        for (uint32_t index = 1; index < slots; ++index)
+        {
+            auto &s = chunks[index >> chunk_bits].load(std::memory_order_relaxed)[index & (chunk_size - 1)];
+            if (s.alive && s.resident && !s.pins && !s.path.empty() && (!victim || s.last_used < victim->last_used))
+                victim = &s;
+        }
+        // Everything left is pinned or can't be reloaded
+        if (!victim)
+            return;
+        evict(*victim);
+    }
+}
+
+TextureManager &GetTextureManager()
+{
+    static TextureManager manager = [] {
+        size_t budget = TextureManager::unlimited;
+        if (auto env = std::getenv("RENDERER_TEXTURE_BUDGET"))
+        {
+            auto megabytes = std::strtoull(env, nullptr, 10);
+            if (megabytes > 0)
+                budget = size_t(megabytes) << 20;
+        }
+        return TextureManager{budget};
+    }();
+    return manager;
+}
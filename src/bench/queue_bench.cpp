@@ -0,0 +1,164 @@
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Contention benchmark of the queues in thread_pool.h
+// Producers push their share of the items, consumers pop until each got an end marker, all of them start together
+// Usage : QueueBench [items] [output.json]
+// Results are written as a json array to output.json (or stdout), progress goes to stderr
+
+constexpr size_t   capacity = 1024;
+constexpr uint64_t end_mark = 0; // items count from 1
+
+struct QueueResult
+{
+    const char *queue;
+    uint32_t    producers, consumers;
+    uint64_t    items;
+    double      ms;
+    double      mops_per_sec;
+};
+
+// LockedQueue never fills, the rings report full and the producer tries again
+template <typename Queue> static void Push(Queue &queue, uint64_t item)
+{
+    if constexpr (std::is_void_v<decltype(queue.push(item))>)
+        queue.push(item);
+    else
+        while (!queue.push(item))
+            std::this_thread::yield();
+}
+
+template <typename Queue> static bool RunOnce(uint32_t producers, uint32_t consumers, uint64_t items, double &ms)
+{
+    auto                     queue = std::make_unique<Queue>();
+    std::atomic<bool>        go{false};
+    std::vector<uint64_t>    sums(consumers);
+    std::vector<std::thread> threads;
+
+    for (uint32_t c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&, c] {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            uint64_t sum = 0, item;
+            for (;;)
+            {
+                // Yield rather than spin, so an oversubscribed machine measures the queue and not the scheduler
+                if (!queue->pop(item))
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (item == end_mark)
+                    break;
+                sum += item;
+            }
+            sums[c] = sum;
+        });
+    }
+    for (uint32_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p] {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (uint64_t item = items * p / producers; item < items * (p + 1) / producers; ++item)
+                Push(*queue, item + 1);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (uint32_t p = 0; p < producers; ++p)
+        threads[consumers + p].join();
+    // Every consumer stops at the first end marker it pops, so one each ends all of them
+    for (uint32_t c = 0; c < consumers; ++c)
+        Push(*queue, end_mark);
+    for (uint32_t c = 0; c < consumers; ++c)
+        threads[c].join();
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t sum = 0;
+    for (auto s : sums)
+        sum += s;
+    return sum == items * (items + 1) / 2;
+}
+
+// Best of a few runs, scheduling noise only ever makes a run slower
+template <typename Queue>
+static bool Run(const char *name, uint32_t producers, uint32_t consumers, uint64_t items, QueueResult &result)
+{
+    constexpr int runs = 3;
+    double        best = 0.0;
+    for (int run = 0; run < runs; ++run)
+    {
+        double ms;
+        if (!RunOnce<Queue>(producers, consumers, items, ms))
+        {
+            fprintf(stderr, "%s lost or duplicated items with %u producers and %u consumers\n", name, producers,
+                    consumers);
+            return false;
+        }
+        best = run ? std::min(best, ms) : ms;
+    }
+    result = QueueResult{name, producers, consumers, items, best, best > 0.0 ? items / best / 1000.0 : 0.0};
+    fprintf(stderr, "%-7s producers %2u consumers %2u : %9.3f ms  %8.2f Mops/s\n", name, producers, consumers,
+            result.ms, result.mops_per_sec);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t    items      = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const char *outputPath = argc > 2 ? argv[2] : nullptr;
+
+    constexpr uint32_t counts[] = {1, 2, 4, 8};
+
+    std::vector<QueueResult> results;
+    bool                     correct = true;
+    auto                     record  = [&](bool ok, QueueResult const &result) {
+        if (ok)
+            results.push_back(result);
+        correct = correct && ok;
+    };
+    for (auto producers : counts)
+    {
+        for (auto consumers : counts)
+        {
+            QueueResult result;
+            record(Run<LockedQueue<uint64_t>>("locked", producers, consumers, items, result), result);
+            record(Run<MPMCQueue<uint64_t, capacity>>("mpmc", producers, consumers, items, result), result);
+            // Single producer single consumer only
+            if (producers == 1 && consumers == 1)
+                record(Run<SPSCQueue<uint64_t, capacity>>("spsc", producers, consumers, items, result), result);
+        }
+    }
+
+    FILE *out = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", outputPath);
+        return -1;
+    }
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        auto const &r = results[i];
+        fprintf(out,
+                "  {\"queue\": \"%s\", \"capacity\": %zu, \"producers\": %u, \"consumers\": %u, \"items\": %llu, "
+                "\"ms\": %.4f, \"mops_per_sec\": %.3f}%s\n",
+                r.queue, capacity, r.producers, r.consumers, (unsigned long long)r.items, r.ms, r.mops_per_sec,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+    if (out != stdout)
+        fclose(out);
+    return correct ? 0 : -1;
+}
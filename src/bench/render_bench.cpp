@@ -0,0 +1,756 @@
+#include "../include/geometry.hpp"
+#include "../include/platform.h"
+#include "../include/rasteriser.h"
+#include "../include/render.h"
+
+#include "../maths/simd.hpp"
+#include "../maths/vec.hpp"
+#include "../utils/job_system.h"
+#include "../utils/memalloc.h"
+#include "../utils/parallel_render.h"
+#include "../utils/shapes.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// End to end frame benchmark for Parallel::ParallelRenderer::AlternativeParallelRenderablePipeline
+// Every scene is animated with a fixed time step so that runs are comparable across builds
+// Usage : RenderBench [frames] [warmup] [output.json] [threads] [clear]
+// threads is a comma separated list of thread counts to scale over, 1,2,4,8,16,32,64 by default
+// clear is eager (default) or lazy for the clear stage of the renderer, none for FastClearColor and ClearDepthBuffer
+// Results are written as a json array to output.json (or stdout), progress goes to stderr
+
+static Platform                                  platform;
+static RLights                                   current_light{};
+static Vec3f                                     cameraPosition = Vec3f(0.0f, 8.0f, 6.0f);
+
+static Parallel::ParallelRenderer                parallel_renderer;
+static std::vector<MonotonicMemoryResource>      resource;
+static std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> MemAllocator;
+
+// Every operator new of the process is counted, a frame in steady state is expected to allocate nothing
+static std::atomic<uint64_t> heap_allocations{0};
+
+void *operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+RLights                                          get_light_source()
+{
+    return current_light;
+}
+
+Vec3f get_camera_position()
+{
+    return cameraPosition;
+}
+
+Platform GetCurrentPlatform()
+{
+    return platform;
+}
+
+Parallel::ParallelRenderer &get_current_parallel_renderer()
+{
+    return parallel_renderer;
+}
+
+static void SwapBuffers()
+{
+}
+
+static bool isKeyPressed(Keys)
+{
+    return false;
+}
+
+static void AllocateBuffers(uint32_t width, uint32_t height)
+{
+    std::free(platform.colorBuffer.buffer);
+    std::free(platform.zBuffer.buffer);
+    std::free(platform.shadowMap.buffer);
+
+    platform.width                  = width;
+    platform.height                 = height;
+
+    platform.colorBuffer.width      = width;
+    platform.colorBuffer.height     = height;
+    platform.colorBuffer.noChannels = 4;
+    platform.colorBuffer.buffer =
+        static_cast<uint8_t *>(std::calloc(width * height * platform.colorBuffer.noChannels, sizeof(uint8_t)));
+
+    platform.zBuffer.width    = width;
+    platform.zBuffer.height   = height;
+    platform.zBuffer.buffer   = static_cast<float *>(std::malloc(sizeof(float) * width * height));
+
+    platform.shadowMap.width  = width;
+    platform.shadowMap.height = height;
+    platform.shadowMap.buffer = static_cast<float *>(std::malloc(sizeof(float) * width * height));
+
+    assert(platform.colorBuffer.buffer && platform.zBuffer.buffer && platform.shadowMap.buffer);
+}
+
+// Scenes
+struct BenchScene
+{
+    std::string                       name;
+    RenderList                        renderables{};
+
+    // Only used by the physics scene
+    PhysicsSimulation::Sphere         sphereA, sphereB, sphereC;
+    PhysicsSimulation::Plane          plane;
+    PhysicsSimulation::PhysicsHandler physics{};
+
+    void (*animate)(BenchScene &scene, float time, float dt) = nullptr;
+
+    uint64_t triangles() const
+    {
+        uint64_t count = 0;
+        for (auto const &renderable : renderables.Renderables)
+            count += renderable.indices.size() / 3;
+        return count;
+    }
+};
+
+static Mat4f SceneTransform(Vec3f const &eye, Vec3f const &target)
+{
+    Mat4f projection = Perspective(platform.width * 1.0f / platform.height, 0.4f / 3 * 3.141592f, 0.3f, 20.0f);
+    return projection * lookAtMatrix(eye, target, Vec3f(0.0f, 1.0f, 0.0f));
+}
+
+static uint32_t CheckerTexture()
+{
+    static uint32_t checker = 0;
+    if (checker)
+        return checker;
+
+    Texture texture;
+    texture.width     = 100;
+    texture.height    = 100;
+    texture.bit_depth = 8;
+    texture.channels  = 1;
+    texture.raw_data  = new uint8_t[texture.width * texture.height];
+
+    constexpr int dim = 10;
+    for (uint32_t h = 0; h < texture.height; ++h)
+        for (uint32_t w = 0; w < texture.width; ++w)
+            texture.raw_data[h * texture.width + w] = ((h / dim + w / dim) % 2 == 0) ? 0xFF : 0x00;
+
+    checker = CreateTextureFromData(texture);
+    return checker;
+}
+
+static RenderInfo Quad(float half_extent, Vec4f color)
+{
+    std::vector<Pipeline3D::VertexAttrib3D> vertices(4);
+    vertices[0].Position = Vec4f(-half_extent, -half_extent, 0.0f, 1.0f);
+    vertices[1].Position = Vec4f(half_extent, -half_extent, 0.0f, 1.0f);
+    vertices[2].Position = Vec4f(half_extent, half_extent, 0.0f, 1.0f);
+    vertices[3].Position = Vec4f(-half_extent, half_extent, 0.0f, 1.0f);
+    vertices[0].TexCoord = Vec2f(0.0f, 0.0f);
+    vertices[1].TexCoord = Vec2f(1.0f, 0.0f);
+    vertices[2].TexCoord = Vec2f(1.0f, 1.0f);
+    vertices[3].TexCoord = Vec2f(0.0f, 1.0f);
+    for (auto &v : vertices)
+        v.Color = color;
+    return RenderInfo(std::move(vertices), {0, 1, 2, 0, 2, 3}, RenderDevice::MergeMode::COLOR_MODE, 0);
+}
+
+// Same scene as the demo in main.cpp : textured floor, bouncing spheres and two cubes
+static void AnimatePhysics(BenchScene &scene, float time, float dt)
+{
+    scene.sphereA.resolve_collision(scene.sphereB, dt);
+    scene.sphereA.resolve_collision(scene.sphereC, dt);
+    scene.sphereB.resolve_collision(scene.sphereC, dt);
+
+    scene.plane.IntersectAndResolve(scene.sphereA, dt);
+    scene.plane.IntersectAndResolve(scene.sphereB, dt);
+    scene.plane.IntersectAndResolve(scene.sphereC, dt);
+
+    static std::vector<Vec3f> cameraLocus = {Vec3f(-15.0f, 8.0f, 10.0f), Vec3f(10.0f, 4.0f, 10.0f),
+                                             Vec3f(10.0f, 4.0f, -10.0f), Vec3f(-10.0f, 2.0f, -10.0f)};
+    float                     t           = std::min(time / 10.0f, 1.0f);
+    cameraPosition                        = BezierBlender.BezierBlending(cameraLocus, t);
+    auto scene_transform =
+        SceneTransform(cameraPosition, Vec3f(0.0f, 4.5f, 0.0f) + t * Vec3f(0.0f, -3.5f, 0.0f));
+
+    auto &renderables = scene.renderables.Renderables;
+    for (auto &renderable : renderables)
+        renderable.scene_transform = scene_transform;
+
+    auto model                   = Mat4f(1.0f);
+    renderables.at(0).model_transform = Mat4f(1.0f).scale({1.5f, 1.5f, 1.0f});
+    renderables.at(1).model_transform =
+        model.translate(scene.sphereA.simulate(dt)).rotateY(time / 5.0f).scale(Vec3f(scene.sphereA.radius));
+    renderables.at(2).model_transform =
+        model.translate(scene.sphereB.simulate(dt)).rotateY(time / 5.0f).scale(Vec3f(scene.sphereB.radius));
+    renderables.at(3).model_transform =
+        model.translate(scene.sphereC.simulate(dt)).rotateY(time / 5.0f).scale(Vec3f(scene.sphereC.radius));
+    renderables.at(4).model_transform = Mat4f(1.0f).translate({4.0f, 1.0f, -4.0f});
+    renderables.at(5).model_transform = Mat4f(1.0f).translate({-4.0f, 1.0f, 4.0f});
+
+    scene.physics.simulate(dt, scene.plane, scene.sphereA, scene.sphereB);
+    scene.physics.render(scene.renderables);
+}
+
+static BenchScene PhysicsScene()
+{
+    BenchScene scene;
+    scene.name           = "physics";
+    scene.animate        = AnimatePhysics;
+
+    scene.plane.coord[0] = Vec3f(-5.0f, 0.0f, 5.0f);
+    scene.plane.coord[1] = Vec3f(5.0f, 0.0f, 5.0f);
+    scene.plane.coord[2] = Vec3f(5.0f, 0.0f, -5.0f);
+    scene.plane.coord[3] = Vec3f(-5.0f, 0.0f, -5.0f);
+
+    std::vector<Pipeline3D::VertexAttrib3D> floor(4);
+    floor[0].Position = Vec4f(-5.0f, 0.0f, 5.0f, 1.0f);
+    floor[1].Position = Vec4f(5.0f, 0.0f, 5.0f, 1.0f);
+    floor[2].Position = Vec4f(5.0f, 0.0f, -5.0f, 1.0f);
+    floor[3].Position = Vec4f(-5.0f, 0.0f, -5.0f, 1.0f);
+    floor[0].TexCoord = Vec2f(0.0f, 0.0f);
+    floor[1].TexCoord = Vec2f(1.0f, 0.0f);
+    floor[2].TexCoord = Vec2f(1.0f, 1.0f);
+    floor[3].TexCoord = Vec2f(0.0f, 1.0f);
+    auto checker      = CheckerTexture();
+    scene.renderables.AddRenderable(
+        RenderInfo(std::move(floor), {0, 1, 2, 0, 2, 3}, RenderDevice::MergeMode::TEXTURE_MODE, checker));
+
+    scene.renderables.AddRenderable(Shape::Sphere::offload(1.0f, 0.2f, 0.2f, {0.0f, 0.5f, 0.5f, 0.0f}));
+    scene.renderables.AddRenderable(Shape::Sphere::offload(1.0f, 0.2f, 0.2f, {0.5f, 0.0f, 0.0f, 0.0f}));
+    scene.renderables.AddRenderable(Shape::Sphere::offload(1.0f, 0.25f, 0.25f, {0.1f, 0.3f, 0.5f, 0.0f}));
+
+    for (auto color : {Vec4f(0.0f, 1.0f, 0.0f, 0.0f), Vec4f(1.0f, 0.0f, 0.0f, 0.0f)})
+    {
+        Object3D                                cube("./macube.obj");
+        std::vector<Pipeline3D::VertexAttrib3D> vertices{};
+        std::vector<uint32_t>                   indices{};
+        cube.LoadGeometry(vertices, indices);
+        for (auto &vertex : vertices)
+            vertex.Color = color;
+        scene.renderables.AddRenderable(
+            RenderInfo(std::move(vertices), std::move(indices), RenderDevice::MergeMode::COLOR_MODE, 0));
+    }
+
+    scene.physics          = PhysicsSimulation::PhysicsHandler(scene.renderables);
+
+    scene.sphereA.radius    = 0.5f;
+    scene.sphereA.center    = Vec3f(0.0f, 40.0f, -50.0f);
+    scene.sphereA.direction = Vec3f(-0.8f, -7.1f, 9.0f);
+    scene.sphereB.radius    = 0.5f;
+    scene.sphereB.center    = Vec3f(0.0f, 3.0f, 25.0f);
+    scene.sphereB.direction = Vec3f(0.0f, 0.0f, -4.80f);
+    scene.sphereC.radius    = 0.5f;
+    scene.sphereC.center    = Vec3f(50.0f, 20.0f, -100.0f);
+    scene.sphereC.direction = Vec3f(-10.0f, -3.5f, 20.0f);
+    return scene;
+}
+
+// A single spinning obj model
+static void AnimateModel(BenchScene &scene, float time, float)
+{
+    cameraPosition       = Vec3f(0.0f, 2.0f, 5.0f);
+    auto scene_transform = SceneTransform(cameraPosition, Vec3f(0.0f, 0.0f, 0.0f));
+    for (auto &renderable : scene.renderables.Renderables)
+    {
+        renderable.scene_transform = scene_transform;
+        renderable.model_transform = Mat4f(1.0f).rotateY(time).rotateX(time / 2.0f);
+    }
+}
+
+static BenchScene ModelScene(std::string const &name, std::string const &path)
+{
+    BenchScene scene;
+    scene.name    = name;
+    scene.animate = AnimateModel;
+
+    Object3D                                model(path);
+    std::vector<Pipeline3D::VertexAttrib3D> vertices{};
+    std::vector<uint32_t>                   indices{};
+    model.LoadGeometry(vertices, indices);
+    for (auto &vertex : vertices)
+        vertex.Color = Vec4f(0.6f, 0.4f, 0.2f, 0.0f);
+    scene.renderables.AddRenderable(
+        RenderInfo(std::move(vertices), std::move(indices), RenderDevice::MergeMode::COLOR_MODE, 0));
+    return scene;
+}
+
+// Overdraw heavy : a stack of quads, each one covering the whole screen
+static void AnimateQuads(BenchScene &scene, float time, float)
+{
+    cameraPosition       = Vec3f(0.0f, 0.0f, 4.0f);
+    auto scene_transform = SceneTransform(cameraPosition, Vec3f(0.0f, 0.0f, 0.0f));
+    auto layer           = 0;
+    for (auto &renderable : scene.renderables.Renderables)
+    {
+        renderable.scene_transform = scene_transform;
+        renderable.model_transform = Mat4f(1.0f).translate({0.0f, 0.0f, -0.1f * layer++}).rotateZ(time * 0.1f);
+    }
+}
+
+static BenchScene FullscreenQuadScene(uint32_t count)
+{
+    BenchScene scene;
+    scene.name    = "fullscreen_quads";
+    scene.animate = AnimateQuads;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        float c = (i + 1) * 1.0f / count;
+        scene.renderables.AddRenderable(Quad(8.0f, Vec4f(c, 1.0f - c, 0.5f, 0.0f)));
+    }
+    return scene;
+}
+
+// Setup bound : a dense grid of tiny triangles, few pixels each
+static void AnimateGrid(BenchScene &scene, float time, float)
+{
+    cameraPosition       = Vec3f(0.0f, 0.0f, 4.0f);
+    auto scene_transform = SceneTransform(cameraPosition, Vec3f(0.0f, 0.0f, 0.0f));
+    for (auto &renderable : scene.renderables.Renderables)
+    {
+        renderable.scene_transform = scene_transform;
+        renderable.model_transform = Mat4f(1.0f).rotateY(0.3f * std::sin(time));
+    }
+}
+
+static BenchScene TinyTriangleScene(uint32_t cells)
+{
+    BenchScene scene;
+    scene.name    = "tiny_triangles";
+    scene.animate = AnimateGrid;
+
+    std::vector<Pipeline3D::VertexAttrib3D> vertices;
+    std::vector<uint32_t>                   indices;
+    constexpr float                         extent = 1.5f;
+    float                                   step   = 2 * extent / cells;
+    for (uint32_t y = 0; y <= cells; ++y)
+    {
+        for (uint32_t x = 0; x <= cells; ++x)
+        {
+            Pipeline3D::VertexAttrib3D v{};
+            v.Position = Vec4f(-extent + x * step, -extent + y * step, 0.0f, 1.0f);
+            v.Color    = Vec4f(x * 1.0f / cells, y * 1.0f / cells, 0.3f, 0.0f);
+            vertices.push_back(v);
+        }
+    }
+    for (uint32_t y = 0; y < cells; ++y)
+    {
+        for (uint32_t x = 0; x < cells; ++x)
+        {
+            uint32_t i = y * (cells + 1) + x;
+            indices.insert(indices.end(), {i, i + 1, i + cells + 2, i, i + cells + 2, i + cells + 1});
+        }
+    }
+    scene.renderables.AddRenderable(
+        RenderInfo(std::move(vertices), std::move(indices), RenderDevice::MergeMode::COLOR_MODE, 0));
+    return scene;
+}
+
+// Culling bound : a field of spheres around the camera, which turns on itself so most of them are out of view
+static void AnimateField(BenchScene &scene, float time, float)
+{
+    cameraPosition       = Vec3f(0.0f, 1.0f, 0.0f);
+    auto target          = Vec3f(std::sin(time * 0.2f), 0.8f, -std::cos(time * 0.2f));
+    auto scene_transform = SceneTransform(cameraPosition, target);
+    for (auto &renderable : scene.renderables.Renderables)
+        renderable.scene_transform = scene_transform;
+}
+
+static BenchScene SphereFieldScene(uint32_t side)
+{
+    BenchScene scene;
+    scene.name    = "sphere_field";
+    scene.animate = AnimateField;
+
+    constexpr float spacing = 2.5f;
+    for (uint32_t z = 0; z < side; ++z)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            float c = (x + z) * 0.5f / side;
+            scene.renderables.AddRenderable(Shape::Sphere::offload(1.0f, 0.2f, 0.2f, {c, 0.3f, 1.0f - c, 0.0f}));
+            scene.renderables.Renderables.back().model_transform =
+                Mat4f(1.0f)
+                    .translate({(x - (side - 1) * 0.5f) * spacing, 0.5f, (z - (side - 1) * 0.5f) * spacing})
+                    .scale(Vec3f(0.5f));
+        }
+    }
+    return scene;
+}
+
+// Results
+using ShadingMode                   = Parallel::ParallelRenderer::ShadingMode;
+using PartitionType                 = Parallel::ParallelRenderer::PartitionType;
+using ClearMode                     = Parallel::ParallelRenderer::ClearMode;
+
+static const char *PartitionName(PartitionType type)
+{
+    switch (type)
+    {
+    case PartitionType::HORIZONTAL:
+        return "horizontal";
+    case PartitionType::VERTICAL:
+        return "vertical";
+    case PartitionType::EQUAL_GRID:
+        return "equal_grid";
+    case PartitionType::ADAPTIVE:
+        return "adaptive";
+    }
+    return "unknown";
+}
+
+static const char *ClearName(ClearMode mode)
+{
+    switch (mode)
+    {
+    case ClearMode::NONE:
+        return "none";
+    case ClearMode::EAGER:
+        return "eager";
+    case ClearMode::LAZY:
+        return "lazy";
+    }
+    return "unknown";
+}
+
+struct BenchResult
+{
+    std::string scene;
+    const char *shading;
+    const char *partition;
+    const char *clear;
+    uint32_t    width, height, threads, frames;
+    uint64_t    triangles_per_frame;
+    double      p50, p95, p99, mean;
+    double      vertex_pass_ms, shadow_pass_ms, main_pass_ms, binning_pass_ms, raster_pass_ms, shading_pass_ms;
+    double      clear_ms;
+    double      triangles_per_sec, fragments_per_sec;
+    // Per frame time each partition spent in its jobs, and max over mean of the shadow pass
+    std::vector<double> shadow_busy_ms, busy_ms;
+    double      shadow_imbalance;
+    // Heap allocations per frame, and the frame arenas of the partitions : largest high water mark of a partition,
+    // chunks held by all of them and chunks they had to allocate over the measured frames
+    double      heap_allocations;
+    size_t      arena_high_water, arena_reserved;
+    uint32_t    arena_chunks, arena_chunks_allocated;
+
+    // Summed over all measured frames
+    Parallel::PipelineStatistics statistics;
+};
+
+static double Percentile(std::vector<double> sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    std::sort(sorted.begin(), sorted.end());
+    // nearest rank
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static BenchResult RunScene(Jobs::Scheduler &scheduler, BenchScene &scene, uint32_t frames, uint32_t warmup, float dt)
+{
+    uint32_t partitions = parallel_renderer.get_partition_count();
+    using clock = std::chrono::steady_clock;
+    std::vector<double> frame_ms;
+    frame_ms.reserve(frames);
+
+    double                       vertex_ms = 0.0, shadow_ms = 0.0, main_ms = 0.0, binning_ms = 0.0, raster_ms = 0.0;
+    double                       shading_ms = 0.0, clear_ms = 0.0, total_ms = 0.0;
+    std::vector<double>          shadow_busy(partitions), busy(partitions);
+    Parallel::PipelineStatistics statistics{};
+    float                        time                   = 0.0f;
+    uint64_t                     allocations            = 0;
+    size_t                       arena_high_water       = 0;
+    uint32_t                     arena_chunks_allocated = 0;
+
+    for (uint32_t frame = 0; frame < warmup + frames; ++frame)
+    {
+        platform.deltaTime = dt;
+        scene.animate(scene, time, dt);
+        time += dt;
+
+        auto allocated = heap_allocations.load(std::memory_order_relaxed);
+        auto start     = clock::now();
+        if (parallel_renderer.get_clear_mode() == ClearMode::NONE)
+        {
+            FastClearColor(0x10, 0x10, 0x10, 0xFF);
+            Pipeline3D::ClearDepthBuffer();
+        }
+        auto cleared = clock::now();
+        parallel_renderer.AlternativeParallelRenderablePipeline(scheduler, scene.renderables, MemAllocator);
+        auto end = clock::now();
+        allocated = heap_allocations.load(std::memory_order_relaxed) - allocated;
+
+        if (frame < warmup)
+            continue;
+
+        allocations += allocated;
+        // Partition i renders with the allocator i + 1
+        for (uint32_t i = 1; i <= partitions; ++i)
+        {
+            arena_high_water = std::max(arena_high_water, resource[i].statistics().high_water);
+            arena_chunks_allocated += resource[i].statistics().chunks_allocated;
+        }
+
+        auto ms = std::chrono::duration<double, std::milli>(end - start).count();
+        frame_ms.push_back(ms);
+        total_ms += ms;
+        // Outside the renderer without its clear stage, in its jobs otherwise
+        clear_ms += std::chrono::duration<double, std::milli>(cleared - start).count() +
+                    parallel_renderer.get_last_timings().clear_pass;
+        vertex_ms += parallel_renderer.get_last_timings().vertex_pass;
+        shadow_ms += parallel_renderer.get_last_timings().shadow_pass;
+        main_ms += parallel_renderer.get_last_timings().main_pass;
+        binning_ms += parallel_renderer.get_last_timings().binning_pass;
+        raster_ms += parallel_renderer.get_last_timings().raster_pass;
+        shading_ms += parallel_renderer.get_last_timings().shading_pass;
+        statistics += parallel_renderer.get_pipeline_statistics();
+        for (uint32_t i = 0; i < partitions; ++i)
+        {
+            auto const &timings = parallel_renderer.get_partition_timings()[i];
+            shadow_busy[i] += timings.shadow_pass;
+            busy[i] += timings.vertex_pass + timings.shadow_pass + timings.main_pass;
+        }
+    }
+
+    BenchResult result{};
+    result.scene               = scene.name;
+    result.shading             = parallel_renderer.get_shading_mode() == ShadingMode::DEFERRED ? "deferred" : "forward";
+    result.partition           = PartitionName(parallel_renderer.get_partition_type());
+    result.clear               = ClearName(parallel_renderer.get_clear_mode());
+    result.width               = platform.width;
+    result.height              = platform.height;
+    result.threads             = scheduler.thread_count();
+    result.frames              = frames;
+    result.triangles_per_frame = scene.triangles();
+    result.p50                 = Percentile(frame_ms, 50);
+    result.p95                 = Percentile(frame_ms, 95);
+    result.p99                 = Percentile(frame_ms, 99);
+    result.mean                = frames ? total_ms / frames : 0.0;
+    result.vertex_pass_ms      = frames ? vertex_ms / frames : 0.0;
+    result.shadow_pass_ms      = frames ? shadow_ms / frames : 0.0;
+    result.main_pass_ms        = frames ? main_ms / frames : 0.0;
+    result.binning_pass_ms     = frames ? binning_ms / frames : 0.0;
+    result.raster_pass_ms      = frames ? raster_ms / frames : 0.0;
+    result.shading_pass_ms     = frames ? shading_ms / frames : 0.0;
+    result.clear_ms            = frames ? clear_ms / frames : 0.0;
+    double seconds             = total_ms / 1000.0;
+    result.triangles_per_sec   = seconds > 0 ? result.triangles_per_frame * frames / seconds : 0.0;
+    result.fragments_per_sec   = seconds > 0 ? statistics.fragments_shaded / seconds : 0.0;
+    result.statistics          = statistics;
+
+    result.heap_allocations       = frames ? double(allocations) / frames : 0.0;
+    result.arena_high_water       = arena_high_water;
+    result.arena_chunks_allocated = arena_chunks_allocated;
+    for (uint32_t i = 1; i <= partitions; ++i)
+    {
+        result.arena_reserved += resource[i].statistics().reserved;
+        result.arena_chunks += resource[i].statistics().chunks;
+    }
+
+    double max_shadow = 0.0, sum_shadow = 0.0;
+    for (uint32_t i = 0; i < partitions; ++i)
+    {
+        result.shadow_busy_ms.push_back(frames ? shadow_busy[i] / frames : 0.0);
+        result.busy_ms.push_back(frames ? busy[i] / frames : 0.0);
+        max_shadow = std::max(max_shadow, result.shadow_busy_ms[i]);
+        sum_shadow += result.shadow_busy_ms[i];
+    }
+    result.shadow_imbalance = sum_shadow > 0.0 ? max_shadow * partitions / sum_shadow : 1.0;
+    return result;
+}
+
+static void WriteResults(FILE *out, std::vector<BenchResult> const &results)
+{
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        auto const &r = results[i];
+        auto const &s = r.statistics;
+        // Counters are reported per frame
+        auto per_frame = [&](uint64_t counter) { return r.frames ? double(counter) / r.frames : 0.0; };
+        auto array     = [](std::vector<double> const &values) {
+            std::string text = "[";
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                char value[32];
+                snprintf(value, sizeof(value), i ? ", %.4f" : "%.4f", values[i]);
+                text += value;
+            }
+            return text + "]";
+        };
+        fprintf(out,
+                "  {\"scene\": \"%s\", \"width\": %u, \"height\": %u, \"threads\": %u, \"simd\": \"%s\", "
+                "\"shading\": \"%s\", \"partition\": \"%s\", \"clear\": \"%s\", \"frames\": %u, "
+                "\"triangles_per_frame\": %llu, "
+                "\"frame_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f}, \"clear_ms\": %.4f, "
+                "\"vertex_pass_ms\": %.4f, \"shadow_pass_ms\": %.4f, \"main_pass_ms\": %.4f, "
+                "\"binning_pass_ms\": %.4f, \"raster_pass_ms\": %.4f, \"shading_pass_ms\": %.4f, "
+                "\"shadow_busy_ms\": %s, \"busy_ms\": %s, \"shadow_imbalance\": %.3f, "
+                "\"triangles_per_sec\": %.1f, \"fragments_per_sec\": %.1f, \"heap_allocations_per_frame\": %.2f, "
+                "\"arena\": {\"high_water_bytes\": %zu, \"reserved_bytes\": %zu, \"chunks\": %u, "
+                "\"chunks_allocated\": %u}, "
+                "\"pipeline_statistics\": {\"renderables_frustum_culled\": %.1f, "
+                "\"triangles_frustum_culled\": %.1f, \"triangles_submitted\": %.1f, "
+                "\"triangles_trivially_rejected\": %.1f, \"triangles_near_clipped\": %.1f, "
+                "\"triangles_screen_clipped\": %.1f, \"triangles_backface_culled\": %.1f, "
+                "\"triangles_zero_area\": %.1f, \"tiles_depth_culled\": %.1f, \"depth_blocks_culled\": %.1f, "
+                "\"blocks_tested\": %.1f, \"fragments_covered\": %.1f, "
+                "\"fragments_passed_depth\": %.1f, \"fragments_shaded\": %.1f}}%s\n",
+                r.scene.c_str(), r.width, r.height, r.threads, SIMD::GetSpanKernel().name, r.shading, r.partition,
+                r.clear, r.frames, (unsigned long long)r.triangles_per_frame, r.p50, r.p95, r.p99, r.mean, r.clear_ms,
+                r.vertex_pass_ms, r.shadow_pass_ms, r.main_pass_ms, r.binning_pass_ms, r.raster_pass_ms,
+                r.shading_pass_ms, array(r.shadow_busy_ms).c_str(), array(r.busy_ms).c_str(), r.shadow_imbalance,
+                r.triangles_per_sec, r.fragments_per_sec, r.heap_allocations, r.arena_high_water, r.arena_reserved,
+                r.arena_chunks, r.arena_chunks_allocated, per_frame(s.renderables_frustum_culled),
+                per_frame(s.triangles_frustum_culled), per_frame(s.triangles_submitted),
+                per_frame(s.triangles_trivially_rejected), per_frame(s.triangles_near_clipped),
+                per_frame(s.triangles_screen_clipped), per_frame(s.triangles_backface_culled),
+                per_frame(s.triangles_zero_area), per_frame(s.tiles_depth_culled),
+                per_frame(s.depth_blocks_culled), per_frame(s.blocks_tested), per_frame(s.fragments_covered),
+                per_frame(s.fragments_passed_depth), per_frame(s.fragments_shaded), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t    frames     = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    uint32_t    warmup     = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10;
+    const char *outputPath = argc > 3 ? argv[3] : nullptr;
+    std::vector<uint32_t> thread_counts;
+    for (char *list = argc > 4 ? argv[4] : nullptr, *end = list; list && *list; list = *end ? end + 1 : end)
+    {
+        auto threads = std::strtoul(list, &end, 10);
+        if (end == list)
+            break;
+        if (threads > 0 && threads <= Parallel::ParallelRenderer::max_partitions)
+            thread_counts.push_back(static_cast<uint32_t>(threads));
+    }
+    if (thread_counts.empty())
+        thread_counts = {1, 2, 4, 8, 16, 32, 64};
+    auto clear_mode = ClearMode::EAGER;
+    if (argc > 5)
+    {
+        std::string clear = argv[5];
+        clear_mode        = clear == "none" ? ClearMode::NONE : clear == "lazy" ? ClearMode::LAZY : ClearMode::EAGER;
+    }
+    // Pins the threads when RENDERER_AFFINITY is set, the thread counts come from the list instead of the environment
+    auto const environment = Jobs::ConfigFromEnvironment();
+
+    constexpr float dt     = 1.0f / 60.0f;
+    struct Resolution
+    {
+        uint32_t width, height;
+    };
+    constexpr Resolution resolutions[] = {{640, 360}, {1280, 720}, {1920, 1080}};
+    struct Configuration
+    {
+        ShadingMode   shading;
+        PartitionType partition;
+    };
+    // Partition layouts only change the shadow pass, so they are measured with forward shading alone
+    // The scaling runs use the first one, the others only run at the highest thread count
+    constexpr Configuration configurations[] = {{ShadingMode::FORWARD, PartitionType::VERTICAL},
+                                                {ShadingMode::DEFERRED, PartitionType::VERTICAL},
+                                                {ShadingMode::FORWARD, PartitionType::HORIZONTAL},
+                                                {ShadingMode::FORWARD, PartitionType::EQUAL_GRID},
+                                                {ShadingMode::FORWARD, PartitionType::ADAPTIVE}};
+
+    platform.SwapBuffer                  = SwapBuffers;
+    platform.bKeyPressed                 = isKeyPressed;
+
+    auto max_threads = *std::max_element(thread_counts.begin(), thread_counts.end());
+    for (uint32_t i = 0; i < max_threads + 2; ++i)
+        resource.emplace_back(MonotonicMemoryResource::default_chunk_size);
+    for (uint32_t i = 0; i < max_threads + 2; ++i)
+        MemAllocator.push_back(MemAlloc<Pipeline3D::VertexAttrib3D>(&resource.at(i)));
+
+    current_light = RLights{.position  = Vec4f(4.0f, 6.0f, 0.0f, 1.0f),
+                            .color     = Vec4f(0.75f, 103.0f / 255.0f, 0.1f, 0x00),
+                            .intensity = 1.0f};
+
+    auto device   = GetRasteriserDevice();
+    device->Context.SetMergeMode(RenderDevice::MergeMode::COLOR_MODE);
+
+    std::vector<BenchResult> results;
+    for (auto threads : thread_counts)
+    {
+        Jobs::Scheduler scheduler{Jobs::SchedulerConfig{.workers = threads - 1, .cores = environment.cores}};
+        for (auto resolution : resolutions)
+        {
+            AllocateBuffers(resolution.width, resolution.height);
+            parallel_renderer = Parallel::ParallelRenderer(resolution.width, resolution.height, threads);
+            parallel_renderer.first_touch(scheduler);
+
+            for (auto const &configuration : configurations)
+            {
+                if (&configuration != configurations && threads != max_threads)
+                    continue;
+                parallel_renderer.set_shading_mode(configuration.shading);
+                parallel_renderer.set_partition_type(configuration.partition);
+                // Same colour as FastClearColor(0x10, 0x10, 0x10, 0xFF), BGRA
+                parallel_renderer.set_clear(clear_mode, {.color = 0xFF101010});
+
+                // Scenes are rebuilt for every configuration so that the physics starts from the same state
+                std::vector<BenchScene> scenes;
+                scenes.push_back(PhysicsScene());
+                scenes.push_back(ModelScene("macube", "./macube.obj"));
+                scenes.push_back(ModelScene("unwrappedorder", "./unwrappedorder.obj"));
+                scenes.push_back(FullscreenQuadScene(16));
+                scenes.push_back(TinyTriangleScene(150));
+                scenes.push_back(SphereFieldScene(16));
+
+                for (auto &scene : scenes)
+                {
+                    if (!scene.triangles())
+                    {
+                        fprintf(stderr, "Skipping scene %s, nothing to render\n", scene.name.c_str());
+                        continue;
+                    }
+                    results.push_back(RunScene(scheduler, scene, frames, warmup, dt));
+                    auto const &r = results.back();
+                    fprintf(stderr,
+                            "%-16s %4ux%-4u threads %2u %-8s %-10s : p50 %8.3f ms  p95 %8.3f ms  p99 %8.3f ms  "
+                            "shadow imbalance %5.2f\n",
+                            r.scene.c_str(), r.width, r.height, threads, r.shading, r.partition, r.p50, r.p95, r.p99,
+                            r.shadow_imbalance);
+                }
+            }
+        }
+    }
+
+    FILE *out = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", outputPath);
+        return -1;
+    }
+    WriteResults(out, results);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -32,6 +32,19 @@ struct RLights // to prevent name clashing with raytracer
     float intensity; // The colorbuffer doesn't support High Dynamic Range, so intensity have to wait 
 };
 
+// Frame constants of the shading stage, read by the raster kernels through RenderDevice::CTX::Uniforms
+// Set once per frame before any triangle is drawn and left untouched while the frame renders
+struct FrameUniforms
+{
+    RLights  light;
+    Vec3f    cameraPos;
+    Mat4f    lightTransform;       // world to light clip space, the space of the shadow map
+    uint32_t shininess   = 32;     // Phong specular exponent
+    float    diffuse     = 0.9f;   // scale of the flat shading term
+    float    shadowBias  = 0.005f; // depth bias of the shadow map test
+    float    shadowShade = 0.2f;   // shade of the fragments in shadow
+};
+
 
 // Need seperate interface for 3D pipeline ?
 struct RenderDevice // <-- Similiar to DirectX device
@@ -70,6 +83,7 @@ struct RenderDevice // <-- Similiar to DirectX device
         Mat4<float>    SceneMatrix{1.0f}; // <-- internal matrix
 
         uint32_t       ActiveTexture{};
+        FrameUniforms  Uniforms{};
 
         void           SetPrimitiveTopolgy(Topology topo)
         {
@@ -93,11 +107,19 @@ struct RenderDevice // <-- Similiar to DirectX device
             return ::GetActiveTexture();
         }
 
+        uint32_t GetActiveTextureID()
+        {
+            return ::GetActiveTextureID();
+        }
+
         void SetTransformMatrix(const Mat4f &matrix)
         {
             SceneMatrix = matrix;
         }
 
+        // Light and camera of the frame, the light matrices are derived from them here
+        void SetFrameUniforms(RLights const &light, Vec3f const &cameraPos);
+
     } Context;
 
     void Draw(Pipeline2D::VertexAttrib2D const &v0, Pipeline2D::VertexAttrib2D const &v1); // <-- Draw lines
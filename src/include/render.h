@@ -1,12 +1,27 @@
 #pragma once
 
 #include "./rasteriser.h"
-#include <vector>
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <vector>
 
 // Helpers to initiate or modify rendering operations
 // Render structs
 
+// Object space bounding volumes, the pipeline tests them against the frustum before touching any triangle
+struct BoundingBox
+{
+    Vec3f min;
+    Vec3f max;
+};
+
+struct BoundingSphere
+{
+    Vec3f center;
+    float radius;
+};
+
 class RenderInfo
 {
 
@@ -19,6 +34,9 @@ class RenderInfo
     Mat4f                                   model_transform;
     std::vector<uint32_t>                   indices;
     std::vector<Pipeline3D::VertexAttrib3D> vertices;
+    // Computed by the constructor, call UpdateBounds() again if the vertices are modified afterwards
+    BoundingBox                             bounding_box{};
+    BoundingSphere                          bounding_sphere{};
     // Optionally material to be used with it
     // Caution : This constructor will force move the vector out of the current container
     // Don't reuse the container after this
@@ -28,6 +46,33 @@ class RenderInfo
         : vertices{std::move(vertexList)}, indices{std::move(indexList)},
           merge_mode{output_merge_mode}, textureID{texture_id_for_texture}
     {
+        UpdateBounds();
+    }
+
+    // Box fitting the vertices, the sphere is centered on the box and reaches the farthest vertex
+    void UpdateBounds()
+    {
+        if (vertices.empty())
+        {
+            bounding_box    = BoundingBox{};
+            bounding_sphere = BoundingSphere{};
+            return;
+        }
+        auto &box = bounding_box;
+        box.min   = Vec3f(vertices.front().Position);
+        box.max   = box.min;
+        for (auto const &vertex : vertices)
+        {
+            auto const &p = vertex.Position;
+            box.min       = Vec3f(std::min(box.min.x, p.x), std::min(box.min.y, p.y), std::min(box.min.z, p.z));
+            box.max       = Vec3f(std::max(box.max.x, p.x), std::max(box.max.y, p.y), std::max(box.max.z, p.z));
+        }
+
+        bounding_sphere.center = (box.min + box.max) * 0.5f;
+        float radius_square    = 0.0f;
+        for (auto const &vertex : vertices)
+            radius_square = std::max(radius_square, (Vec3f(vertex.Position) - bounding_sphere.center).normSquare());
+        bounding_sphere.radius = std::sqrt(radius_square);
     }
     RenderInfo(RenderInfo const &render_info) = delete;
     RenderInfo &operator=(RenderInfo const &render_info) = delete;
@@ -16,9 +16,11 @@ void RenderBackground(BackgroundTexture const &texture);
 uint32_t CreateTexture(const char *img_path);
 uint32_t CreateTextureFromData(Texture &texture);
 
-Texture  GetTexture(uint32_t textureID);
-void     SetActiveTexture(uint32_t texture);
-Texture  GetActiveTexture();
+// Handles come from the texture manager, see texture_manager.h
+Texture const *GetTexture(uint32_t textureID);
+void           SetActiveTexture(uint32_t texture);
+Texture const *GetActiveTexture();
+uint32_t       GetActiveTextureID();
 
 void     ImageViewer(uint8_t *img_buffer, uint8_t *buffer, uint32_t image_width, uint32_t image_height,
                      uint32_t image_channels, uint32_t buffer_width, uint32_t buffer_height, uint32_t buffer_channels,
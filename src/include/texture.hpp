@@ -5,6 +5,97 @@
 #include "./platform.h"
 #include <cstdint>
 #include <format>
+#include <immintrin.h>
+#include <vector>
+
+namespace Jobs
+{
+class Scheduler;
+}
+
+struct Texture;
+
+// Filtering of textures 4 lanes at a time, matching the 4 pixel groups of the raster kernels
+// Bound from a texture once, the bilinear fetch is then specialised on the texel format and the addressing mode so
+// that neither is branched on per sample
+struct TextureSampler
+{
+    // Outputs are the three colour channels of each lane in [0, 255], a single channel texture repeats its channel
+    using SampleFn = void (*)(TextureSampler const &sampler, __m128 u, __m128 v, __m128 lod, __m128 rgb[3]);
+
+    static constexpr uint32_t max_levels = 16;
+
+    uint8_t const            *texels;
+    int32_t                   levels;
+    // Level descriptors, one table per field so that they can be gathered per lane
+    alignas(16) int32_t       width[max_levels];
+    alignas(16) int32_t       height[max_levels];
+    alignas(16) int32_t       tiles_x[max_levels];
+    alignas(16) int32_t       offset[max_levels];
+    SampleFn                  sample;
+
+    // Trilinear filtering, bilinear in the two levels around lod, log2 of the texels covered by a pixel, and a blend
+    // of the two
+    void Sample4(__m128 u, __m128 v, __m128 lod, __m128 rgb[3]) const
+    {
+        sample(*this, u, v, lod, rgb);
+    }
+
+    Vec3f Sample(Vec2f uv, float lod) const
+    {
+        alignas(16) float r[4], g[4], b[4];
+        __m128 rgb[3];
+        sample(*this, _mm_set1_ps(uv.x), _mm_set1_ps(uv.y), _mm_set1_ps(lod), rgb);
+        _mm_store_ps(r, rgb[0]);
+        _mm_store_ps(g, rgb[1]);
+        _mm_store_ps(b, rgb[2]);
+        return Vec3f(r[0], g[0], b[0]);
+    }
+};
+
+// One dimensional filter of an image convolution, taps[radius] weights the centre texel
+// Box filters of the given radii are run after the taps, a cascade of 3 of them stands in for a wide Gaussian at a cost
+// that doesn't depend on the radius
+struct SeparableKernel
+{
+    static constexpr int32_t max_radius = 8;
+    static constexpr int32_t max_boxes  = 3;
+
+    int32_t radius = 0;
+    float   taps[2 * max_radius + 1] = {1.0f};
+    int32_t boxes = 0;
+    int32_t box_radius[max_boxes] = {};
+};
+
+// 2D kernel written as centre * identity + the sum of scale * (x (outer) y), any 3x3 kernel of rank 2 or less fits
+struct FilterKernel
+{
+    static constexpr uint32_t max_terms = 2;
+
+    struct Term
+    {
+        float           scale;
+        SeparableKernel x, y;
+    };
+
+    float    centre = 0.0f;
+    uint32_t terms  = 0;
+    Term     term[max_terms];
+};
+
+// Float planes the passes of Texture::Convolve ping-pong between, one 4 channel pixel per element
+// Kept by the caller, filtering an image no larger than the previous one doesn't allocate
+struct ConvolutionScratch
+{
+    // Aligned for the SSE loads and stores of the passes, __m128 itself can't be a vector element without dropping its
+    // attributes
+    struct alignas(16) Pixel
+    {
+        float rgba[4];
+    };
+
+    std::vector<Pixel> planes[4];
+};
 
 struct Texture
 {
@@ -25,82 +116,66 @@ struct Texture
         BILINEAR
     };
 
-    struct Convolution
+    // Out of range coordinates either repeat the texture or clamp to its edge
+    enum class Addressing
     {
-        static inline struct GaussianBlur
-        {
-            constexpr static float32 kernel[] = {1.0f / 16, 2.0f / 16, 1.0f / 16, 2.0f / 16, 4.0f / 16,
-                                                 2.0f / 16, 1.0f / 16, 2.0f / 16, 1.0f / 16}; // --> Gaussian Blur
-        } GaussianBlur;
-        static inline struct Sharpen
-        {
-            constexpr static float32 kernel[] = {0, -1, 0, -1, 5, -1, 0, -1, 0}; // --> Sharpen
-        } Sharpen;
-        static inline struct EdgeDetection
-        {
-            constexpr static float32 kernel[] = {-1, -1, -1, -1, 8, -1, -1, -1, -1};
-        } EdgeDetection;
-        constexpr static Vec2<int16_t> Sampler[] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {0, 0},
-                                                    {1, 0},   {-1, 1}, {0, 1},  {1, 1}};
+        WRAP,
+        CLAMP
     };
 
-    Vec3u8 Sample(Vec2f uv, Interpolation type = Interpolation::NEAREST);
+    Addressing addressing = Addressing::CLAMP;
 
-    // <-- Returns the Gaussian Blurred image of the currently holding texture .. Will allocate
+    // Mip chain of raw_data, built by GenerateMips when the texture is registered
+    // Each level is stored in tiles of 4x4 texels, tiles row by row and the texels of a tile in Morton (Z) order, so a
+    // 2x2 filter footprint mostly stays within one tile and an RGBA8 tile is a single cache line
+    static constexpr uint32_t tile_bits  = 2;
+    static constexpr uint32_t tile_dim   = 1 << tile_bits;
+    static constexpr uint32_t max_levels = TextureSampler::max_levels;
 
-    // Its one of the C++20's fancy features
-    // Lol requires need to be repeated in both declaration and definition
-    template <typename T> uint8_t *Convolve(T kernel) requires requires
+    struct MipLevel
     {
-        kernel.kernel;
+        uint32_t width, height;
+        uint32_t tiles_x;
+        size_t   offset; // into mips, in bytes
     };
 
-    void ViewImage(uint8_t *buffer, uint32_t buffer_width, uint32_t buffer_height, uint32_t buffer_channels,
-                   uint32_t target_width, uint32_t target_height);
-};
+    uint8_t *mips      = nullptr;
+    size_t   mip_bytes = 0;
+    uint32_t levels    = 0;
+    MipLevel mip[max_levels];
 
-// Lmao .. static linkage fiasco ... This method is unique but ...
-template <typename T> inline uint8_t *Texture::Convolve(T kernel) requires requires
-{
-    kernel.kernel;
-}
-{
-    auto     kern     = kernel.kernel;
-    uint8_t *gaussian = new uint8_t[width * height * channels];
-    // We gonna use ranges zip
-    // auto pair = std::ranges::zip .. lol not supported till
-
-    auto clamp = [=](int16_t x) {
-        x = x > 255 ? 255 : x;
-        return x < 0 ? (uint8_t)0 : (uint8_t)x;
+    struct Convolution
+    {
+        static constexpr SeparableKernel Binomial3{.radius = 1, .taps = {0.25f, 0.5f, 0.25f}};
+        static constexpr SeparableKernel Sum3{.radius = 1, .taps = {1.0f, 1.0f, 1.0f}};
+        static constexpr SeparableKernel Identity{};
+
+        // 1 2 1 / 2 4 2 / 1 2 1, over 16
+        static constexpr FilterKernel GaussianBlur{.terms = 1, .term = {{1.0f, Binomial3, Binomial3}}};
+        // 0 -1 0 / -1 5 -1 / 0 -1 0, the centre minus the row and the column through it
+        static constexpr FilterKernel Sharpen{
+            .centre = 7.0f, .terms = 2, .term = {{-1.0f, Sum3, Identity}, {-1.0f, Identity, Sum3}}};
+        // -1 -1 -1 / -1 8 -1 / -1 -1 -1, the centre minus the 3x3 sum
+        static constexpr FilterKernel EdgeDetection{.centre = 9.0f, .terms = 1, .term = {{-1.0f, Sum3, Sum3}}};
+
+        // Sampled taps while they are few, a cascade of box filters of the same variance beyond that
+        static FilterKernel Gaussian(float sigma);
     };
 
-    uint8_t *pixel;
-    for (int h = 1; h < height - 1; ++h)
-    {
-        for (int w = 1; w < width - 1; ++w)
-        {
-            // Do one dimensional Gaussian blur first ? or what?
-            // No, do 2D Gaussian Blur first
-            Vec3f color{};
-            for (int k = 0; k < 9; ++k)
-            {
-                uint32_t x, y;
-                x            = Convolution::Sampler[k].x + w;
-                y            = Convolution::Sampler[k].y + h;
-                pixel        = raw_data + (y * this->width + x) * channels;
-                Vec3f pColor = Vec3f(pixel[0], pixel[1], pixel[2]);
-                color        = color + kern[k] * pColor;
-            }
-            pixel    = gaussian + (width * h + w) * channels;
+    Vec3u8 Sample(Vec2f uv, Interpolation type = Interpolation::NEAREST) const;
 
-            pixel[0] = clamp(color.x);
-            pixel[1] = clamp(color.y);
-            pixel[2] = clamp(color.z);
-        }
-    }
-    return gaussian;
-}
+    // Box filtered levels down to 1x1, replaces the chain built earlier
+    void           GenerateMips();
+    // Sampler of the mip chain, picks the fetch for the channel count (R8, RGB8 or RGBA8) and the addressing
+    TextureSampler Bind() const;
+
+    // Filters raw_data in place, texels beyond the edges repeat the edge
+    // Every pass is split in rows (or columns) across the scheduler
+    void Convolve(FilterKernel const &kernel, Jobs::Scheduler &scheduler, ConvolutionScratch &scratch);
+
+    void ViewImage(uint8_t *buffer, uint32_t buffer_width, uint32_t buffer_height, uint32_t buffer_channels,
+                   uint32_t target_width, uint32_t target_height);
+};
 
 // Naive updating of Background Texture
 
@@ -116,16 +191,27 @@ struct BackgroundTexture
 
     uint8_t *raw_bckg_data = nullptr;
 
+    ConvolutionScratch scratch;
+
     void     CreateBackgroundTexture(std::string_view image_path)
     {
         texture.raw_data =
             LoadPNGFromFile(image_path.data(), &texture.width, &texture.height, &texture.channels, &texture.bit_depth);
+        if (!texture.raw_data)
+        {
+            // Missing background (e.g. headless runs outside the asset directory), fall back to plain sky color
+            texture.width     = 1;
+            texture.height    = 1;
+            texture.channels  = 3;
+            texture.bit_depth = 8;
+            texture.raw_data  = new uint8_t[3]{0x87, 0xCE, 0xEB};
+        }
         std::cerr << std::format("Loaded PNG {}, width : {}, height :{}\n", image_path.data(), texture.width,
                                  texture.height)
                   << std::endl;
     }
 
-    void SampleForCurrentFrameBuffer(Platform *platform, bool applyGaussianBlur)
+    void SampleForCurrentFrameBuffer(Platform *platform, bool applyGaussianBlur, Jobs::Scheduler &scheduler)
     {
         if (raw_bckg_data)
             delete[] raw_bckg_data;
@@ -164,7 +250,7 @@ struct BackgroundTexture
 
         if (applyGaussianBlur)
         {
-            // use the result above to apply gaussian blue several times
+            // Blurred as much as 20 rounds of the 3x3 Gaussian, whose variance is 1/2 along each axis, in one go
             Texture blur;
             blur.bit_depth              = texture.bit_depth;
             blur.channels               = cbuffer_channels;
@@ -172,13 +258,7 @@ struct BackgroundTexture
             blur.height                 = cbuffer_height;
             blur.raw_data               = raw_bckg_data;
             constexpr int GaussianCount = 20;
-            for (int times = 0; times < GaussianCount; ++times)
-            {
-                auto newblur = blur.Convolve(Texture::Convolution::GaussianBlur);
-                delete[] blur.raw_data; 
-                blur.raw_data = newblur; 
-            }
-            raw_bckg_data = blur.raw_data;
+            blur.Convolve(Texture::Convolution::Gaussian(std::sqrt(GaussianCount * 0.5f)), scheduler, scratch);
         }
     }
 };
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "./texture.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Registry of every texture, CreateTexture and friends in renderer.h go through the global one
+// Handles stay valid until the last reference is released, a released handle never resolves to a texture created
+// later in its slot. A handle is the slot index and a generation bumped on every release, a slot whose generations are
+// used up (4096 textures) is retired for good rather than wrapping around
+// Texture objects never move, Lookup hands out pointers to them without locking
+// Textures loaded from a file may have their texels evicted, least recently pinned first, whenever the resident bytes
+// go over the budget. Pin loads them again and keeps them resident until Unpin, the renderer pins the textures of a
+// frame for as long as it renders
+class TextureManager
+{
+  public:
+    using Handle                       = uint32_t; // 0 is never a texture
+    static constexpr size_t unlimited  = std::numeric_limits<size_t>::max();
+    static constexpr size_t chunk_bits = 8;
+    static constexpr size_t max_chunks = 256;
+
+    struct Statistics
+    {
+        size_t   resident_bytes; // texels and mips of the resident textures
+        size_t   budget;
+        uint32_t textures;
+        uint32_t resident;
+        uint64_t evictions;
+        uint64_t reloads;
+        uint32_t retired; // slots whose generations ran out, never handed out again
+    };
+
+    explicit TextureManager(size_t budget = unlimited);
+    ~TextureManager();
+
+    TextureManager(TextureManager const &)            = delete;
+    TextureManager &operator=(TextureManager const &) = delete;
+
+    // Loads the PNG at path, 0 if it can't be read. The handle holds one reference
+    Handle          Create(const char *path);
+    // Registers a texture built in memory, its raw_data stays owned by the caller
+    // There is nothing to reload it from, so it is never evicted
+    Handle          Create(Texture const &texture);
+
+    void            Retain(Handle handle);
+    // The last reference frees the texture, once it isn't pinned anymore
+    void            Release(Handle handle);
+
+    // Makes the texture resident, loading it again if it was evicted, and keeps it so until Unpin
+    // nullptr if the handle is stale or the file can't be read anymore
+    Texture const  *Pin(Handle handle);
+    void            Unpin(Handle handle);
+
+    // Texels may only be read while the texture is pinned, or if it was created from memory
+    Texture const  *Lookup(Handle handle) const;
+
+    // Evicts right away if the resident textures don't fit anymore
+    void            SetBudget(size_t bytes);
+    Statistics      GetStatistics() const;
+
+  private:
+    static constexpr uint32_t index_bits     = 20;
+    static constexpr uint32_t index_mask     = (1u << index_bits) - 1;
+    static constexpr uint32_t max_generation = 0xFFFFFFFFu >> index_bits;
+    static constexpr size_t   chunk_size = size_t(1) << chunk_bits;
+
+    struct Slot
+    {
+        Texture               texture{};
+        std::string           path; // empty for textures created from memory
+        std::atomic<uint32_t> generation{0};
+        uint32_t              index      = 0;
+        bool                  alive      = false;
+        bool                  resident   = false;
+        uint32_t              references = 0;
+        uint32_t              pins       = 0;
+        uint64_t              last_used  = 0;
+        size_t                bytes      = 0;
+    };
+
+    Slot       *slot(Handle handle) const;
+    Handle      insert(Texture const &texture, std::string path);
+    void        evict(Slot &slot);
+    void        destroy(Slot &slot);
+    void        enforce_budget();
+
+    // Chunks are only ever added, a slot keeps its address for the life time of the manager
+    std::atomic<Slot *>                  chunks[max_chunks] = {};
+    std::vector<std::unique_ptr<Slot[]>> storage;
+    std::vector<uint32_t>                free_slots;
+    uint32_t                             slots = 1; // slot 0 is never used, handle 0 stays invalid
+
+    mutable std::mutex                   lock;
+    size_t                               budget;
+    size_t                               resident_bytes = 0;
+    uint32_t                             textures       = 0;
+    uint32_t                             resident       = 0;
+    uint64_t                             clock          = 0; // counts pins, orders the textures for eviction
+    uint64_t                             evictions      = 0;
+    uint64_t                             reloads        = 0;
+    uint32_t                             retired        = 0;
+};
+
+// Global manager, its budget is RENDERER_TEXTURE_BUDGET megabytes or unlimited
+TextureManager &GetTextureManager();
@@ -10,6 +10,7 @@
 #include "./utils/memalloc.h"
 #include "./utils/parallel_render.h"
 #include "./utils/shapes.h"
+#include "./utils/job_system.h"
 #include "./utils/thread_pool.h"
 
 // Lets now work on lighting
@@ -33,10 +34,13 @@ BackgroundTexture                       bckg;
 std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> MemAllocator;
 std::vector<MonotonicMemoryResource>              resource;
 // making thread_pool thread_local is thread bomb .. insta OS stop responding
-// ThreadPool                                        thread_pool{};
-
-Alternative::ThreadPool    thread_pool{};
+// Workers park when idle, so nothing spins between frames
+// One thread per core by default, RENDERER_THREADS and RENDERER_AFFINITY change the count and pin them
+Jobs::Scheduler            scheduler{Jobs::ConfigFromEnvironment()};
 Parallel::ParallelRenderer parallel_renderer;
+// Frames the simulation runs ahead of the renderer, 0 simulates and renders one after the other, 1 simulates the next
+// frame while the current one renders. Scene state is copied by the renderer, so more than one needs more framebuffers
+constexpr uint32_t         frame_latency = 1;
 
 // Small physics simulation demo
 PhysicsSimulation::Sphere sphereA, sphereB, sphereC;
@@ -97,6 +101,96 @@ Vec3f getFrontVector(Platform *platform)
     return fVector;
 }
 
+// Physics, camera and transforms of the next frame
+// Runs on the calling thread, every collision step moves spheres the others read. It overlaps with the frame in flight
+// instead, see frame_latency
+static void SimulateScene(Platform *platform)
+{
+    static float time = 0.0f;
+    // current_light.position = Vec4f(0.0f, 50.0f, 5.0f, 1.0f);
+    // rotate light
+    // current_light.position = Vec4f(2 * cos(time / 20.0f), 2.0f, 2 * sin(time / 20.0f), 1.0f);
+    // cameraPosition.z += 0.01f;
+    // current_light.position.z -= 0.001f;
+    // current_light.position.y += 0.001f;
+
+    platform->deltaTime /= 1;
+    if (time > 4.9f and time <= 5.5f)
+    {
+        platform->deltaTime /= 10;
+    }
+    time += platform->deltaTime;
+    static auto t       = 0.0f; 
+    static bool reverse = false;
+    t                   += platform->deltaTime/ 10.0f;
+    if (time > 8.0f)
+    {
+        t               -= 2*platform->deltaTime / 10.0f;
+        static auto rem = time; 
+        if (!reverse)
+        {
+            reverse           = true;
+            sphereA.direction = sphereA.direction * -1.0f;
+            sphereB.direction = sphereB.direction * -1.0f;
+            sphereC.direction = sphereC.direction * -1.0f;
+
+            for (auto & sph : physics.spheres)
+            {
+                sph.direction = sph.direction * -1.0f; 
+                sph.coefficient_of_restitution = 1 / sph.coefficient_of_restitution;
+            }
+        }
+
+    }
+
+    // Slows time during collision phase 
+    using namespace Pipeline3D;
+    Mat4f transform = Perspective(platform->width * 1.0f / platform->height, 0.4f / 3 * 3.141592f, 0.3f, 20.0f);
+    /*auto transform = OrthoProjection(-5.0f, 5.0f, -5.0f, 5.0f, -5.0f, 10.0f);
+     */
+    sphereA.resolve_collision(sphereB, platform->deltaTime);
+    sphereA.resolve_collision(sphereC, platform->deltaTime);
+    sphereB.resolve_collision(sphereC, platform->deltaTime);
+    
+    plane.IntersectAndResolve(sphereA, platform->deltaTime);
+    plane.IntersectAndResolve(sphereB, platform->deltaTime);
+    plane.IntersectAndResolve(sphereC, platform->deltaTime);
+
+    auto model = Mat4f(1.0f);
+    // .rotateY(time); //.rotateX(time / 2.0f);
+    // Math is magic
+    cameraPosition  = BezierBlender.BezierBlending(cameraLocus, t);
+
+    auto lookMatrix = lookAtMatrix(cameraPosition,
+                                   Vec3f(0.0f, 4.5f, 0.0f) + t * Vec3f(0.0f,-3.5f,0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+   /* auto lookMatrix = lookAtMatrix(cameraPosition, cameraPosition + getFrontVector(platform), Vec3f(0.0f, 1.0f,
+     0.0f));*/
+
+    // seperate the model matrix from here to other space, since we also ned to interpolate the vertex position like
+    // other things in the screen space to calculate other effects so basically yes, its all to calculate fragpos Lets
+    // implement flat shading for now, instead of per pixel lighting .. we will come back to it
+    for (auto &renderable : Renderables.Renderables)
+    {
+        renderable.scene_transform = transform * lookMatrix;
+        // renderable.model_transform = model;
+    }
+    Renderables.Renderables.at(0).model_transform = Mat4f(1.0f).scale({1.5f, 1.5f, 1.0f});
+    Renderables.Renderables.at(1).model_transform =
+        model.translate(sphereA.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereA.radius));
+    Renderables.Renderables.at(2).model_transform =
+        model.translate(sphereB.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereB.radius));
+    Renderables.Renderables.at(3).model_transform =
+        model.translate(sphereC.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereC.radius));
+
+    Renderables.Renderables.at(4).model_transform = Mat4f(1.0f).translate({4.0f, 1.0f, -4.0f});
+    Renderables.Renderables.at(5).model_transform = Mat4f(1.0f).translate({-4.0f, 1.0f, 4.0f});
+    // Renderables.Renderables.at(2).model_transform = Mat4f(1.0f).translate({1.0f, 1.0f, -0.5f});
+
+    physics.simulate(platform->deltaTime, plane, sphereA, sphereB);
+
+    physics.render(Renderables);
+}
+
 void RendererMainLoop(Platform *platform)
 {
 
@@ -131,15 +225,19 @@ void RendererMainLoop(Platform *platform)
             // platform->SetOpacity(1.0f);
             // fancyTexture = model.Materials.at(0).texture_id;
             //  catTexture   = model2.Materials.at(0).texture_id;
-            for (int i = 0; i < 8; ++i)
+            // One per partition and a spare, every thread running jobs gets a partition
+            uint32_t partitions = vMin(scheduler.thread_count(), Parallel::ParallelRenderer::max_partitions);
+            for (uint32_t i = 0; i < partitions + 2; ++i)
             {
-                resource.push_back(MonotonicMemoryResource{std::malloc(1024 * 1024), 1024 * 1024});
+                resource.emplace_back(MonotonicMemoryResource::default_chunk_size);
             }
-            for (int i = 0; i < 8; ++i)
+            for (uint32_t i = 0; i < partitions + 2; ++i)
             {
                 MemAllocator.push_back(MemAlloc<Pipeline3D::VertexAttrib3D>(&resource.at(i)));
             }
-            parallel_renderer = Parallel::ParallelRenderer(platform->colorBuffer.width, platform->colorBuffer.height);
+            parallel_renderer =
+                Parallel::ParallelRenderer(platform->colorBuffer.width, platform->colorBuffer.height, partitions);
+            parallel_renderer.first_touch(scheduler);
 
             // Create a checked texture
             plane.coord[0] = Vec3f(-5.0f, 0.0f, 5.0f);
@@ -242,7 +340,7 @@ void RendererMainLoop(Platform *platform)
         }
 	
         bckg.CreateBackgroundTexture("./img103.png");
-        bckg.SampleForCurrentFrameBuffer(platform, false);
+        bckg.SampleForCurrentFrameBuffer(platform, false, scheduler);
         /*  cameraPosition    = Vec3f(0.0f, 8.0f, 6.0f);
           sphereA.radius    = 0.5f;
           sphereA.center    = Vec3f(0.0f, 8.0f, -10.0f);
@@ -269,98 +367,38 @@ void RendererMainLoop(Platform *platform)
     else if (platform->bSizeChanged)
     {
         platform->bSizeChanged = false;
-        parallel_renderer      = Parallel::ParallelRenderer(platform->colorBuffer.width, platform->colorBuffer.height);
-        bckg.SampleForCurrentFrameBuffer(platform, true);
-    }
-    static float time = 0.0f;
-    // current_light.position = Vec4f(0.0f, 50.0f, 5.0f, 1.0f);
-    // rotate light
-    // current_light.position = Vec4f(2 * cos(time / 20.0f), 2.0f, 2 * sin(time / 20.0f), 1.0f);
-    // cameraPosition.z += 0.01f;
-    // current_light.position.z -= 0.001f;
-    // current_light.position.y += 0.001f;
-
-    platform->deltaTime /= 1;
-    if (time > 4.9f and time <= 5.5f)
-    {
-        platform->deltaTime /= 10;
-    }
-    time += platform->deltaTime;
-    static auto t       = 0.0f; 
-    static bool reverse = false;
-    t                   += platform->deltaTime/ 10.0f;
-    if (time > 8.0f)
-    {
-        t               -= 2*platform->deltaTime / 10.0f;
-        static auto rem = time; 
-        if (!reverse)
-        {
-            reverse           = true;
-            sphereA.direction = sphereA.direction * -1.0f;
-            sphereB.direction = sphereB.direction * -1.0f;
-            sphereC.direction = sphereC.direction * -1.0f;
-
-            for (auto & sph : physics.spheres)
-            {
-                sph.direction = sph.direction * -1.0f; 
-                sph.coefficient_of_restitution = 1 / sph.coefficient_of_restitution;
-            }
-        }
-
+        auto shading_mode      = parallel_renderer.get_shading_mode();
+        auto partition_type    = parallel_renderer.get_partition_type();
+        auto partitions        = parallel_renderer.get_partition_count();
+        parallel_renderer =
+            Parallel::ParallelRenderer(platform->colorBuffer.width, platform->colorBuffer.height, partitions);
+        parallel_renderer.first_touch(scheduler);
+        parallel_renderer.set_shading_mode(shading_mode);
+        parallel_renderer.set_partition_type(partition_type);
+        bckg.SampleForCurrentFrameBuffer(platform, true, scheduler);
     }
-
-    // Slows time during collision phase 
-    RenderBackground(bckg);
-    // ClearColor(0xFF,0xFF, 0x00);
-    
-    // FastClearColor(0x10, 0x10, 0x10, 0x00);
-    using namespace Pipeline3D;
-    Mat4f transform = Perspective(platform->width * 1.0f / platform->height, 0.4f / 3 * 3.141592f, 0.3f, 20.0f);
-    /*auto transform = OrthoProjection(-5.0f, 5.0f, -5.0f, 5.0f, -5.0f, 10.0f);
-     */
-    sphereA.resolve_collision(sphereB, platform->deltaTime);
-    sphereA.resolve_collision(sphereC, platform->deltaTime);
-    sphereB.resolve_collision(sphereC, platform->deltaTime);
-    
-    plane.IntersectAndResolve(sphereA, platform->deltaTime);
-    plane.IntersectAndResolve(sphereB, platform->deltaTime);
-    plane.IntersectAndResolve(sphereC, platform->deltaTime);
-
-    ClearDepthBuffer();
-    auto model = Mat4f(1.0f);
-    // .rotateY(time); //.rotateX(time / 2.0f);
-    // Math is magic
-    cameraPosition  = BezierBlender.BezierBlending(cameraLocus, t);
-
-    auto lookMatrix = lookAtMatrix(cameraPosition,
-                                   Vec3f(0.0f, 4.5f, 0.0f) + t * Vec3f(0.0f,-3.5f,0.0f), Vec3f(0.0f, 1.0f, 0.0f));
-   /* auto lookMatrix = lookAtMatrix(cameraPosition, cameraPosition + getFrontVector(platform), Vec3f(0.0f, 1.0f,
-     0.0f));*/
-
-    // seperate the model matrix from here to other space, since we also ned to interpolate the vertex position like
-    // other things in the screen space to calculate other effects so basically yes, its all to calculate fragpos Lets
-    // implement flat shading for now, instead of per pixel lighting .. we will come back to it
-    for (auto &renderable : Renderables.Renderables)
+    // Only the render list and the renderer settings have to stay put while a frame renders, see BeginFrame
+    // With a frame of latency the frame shows the scene simulated during the previous one, whose simulation ran while
+    // the frame before that was rendered
+    static bool simulated = false;
+    if (!frame_latency || !simulated)
+        SimulateScene(platform);
+
+    // The renderer copies the background in and clears depth and shadow map in the jobs of its vertex pass
+    parallel_renderer.set_clear(Parallel::ParallelRenderer::ClearMode::EAGER, {.background = bckg.raw_bckg_data});
+
+    // V shades through the visibility buffer, F goes back to forward shading
+    if (platform->bKeyPressed(Keys::V))
+        parallel_renderer.set_shading_mode(Parallel::ParallelRenderer::ShadingMode::DEFERRED);
+    else if (platform->bKeyPressed(Keys::F))
+        parallel_renderer.set_shading_mode(Parallel::ParallelRenderer::ShadingMode::FORWARD);
+    parallel_renderer.BeginFrame(scheduler, Renderables, MemAllocator);
+    if (frame_latency)
     {
-        renderable.scene_transform = transform * lookMatrix;
-        // renderable.model_transform = model;
+        SimulateScene(platform);
+        simulated = true;
     }
-    Renderables.Renderables.at(0).model_transform = Mat4f(1.0f).scale({1.5f, 1.5f, 1.0f});
-    Renderables.Renderables.at(1).model_transform =
-        model.translate(sphereA.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereA.radius));
-    Renderables.Renderables.at(2).model_transform =
-        model.translate(sphereB.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereB.radius));
-    Renderables.Renderables.at(3).model_transform =
-        model.translate(sphereC.simulate(platform->deltaTime)).rotateY(time / 5.0f).scale(Vec3f(sphereC.radius));
-
-    Renderables.Renderables.at(4).model_transform = Mat4f(1.0f).translate({4.0f, 1.0f, -4.0f});
-    Renderables.Renderables.at(5).model_transform = Mat4f(1.0f).translate({-4.0f, 1.0f, 4.0f});
-    // Renderables.Renderables.at(2).model_transform = Mat4f(1.0f).translate({1.0f, 1.0f, -0.5f});
-
-    physics.simulate(platform->deltaTime, plane, sphereA, sphereB);
-
-    physics.render(Renderables);
-    parallel_renderer.AlternativeParallelRenderablePipeline(thread_pool, Renderables, MemAllocator);
+    parallel_renderer.EndFrame();
     // Visualize the shadow depth buffer
     // This good ... now render form light's perspective
     // So, without model transform, our mesh is basically at the centre of the world. and light is exactly above it,
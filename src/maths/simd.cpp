@@ -0,0 +1,259 @@
+#include "./simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <iterator>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+// Kernels pass wide registers between inlined helpers only, there is no ABI boundary to worry about
+#pragma GCC diagnostic ignored "-Wpsabi"
+// flatten inlines the generic kernel and the Lanes helpers into the wrapper, so all of it is compiled for the target
+#define SIMD_KERNEL(isa) __attribute__((target(isa), flatten))
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+// MSVC allows any intrinsic in any function
+#define SIMD_KERNEL(isa)
+#define SIMD_TARGET(isa)
+#endif
+
+namespace SIMD
+{
+// Each Lanes<ISA> specialisation wraps one register type with a compile time lane count
+template <ISA isa> struct Lanes;
+
+template <> struct Lanes<ISA::SCALAR>
+{
+    constexpr static int32_t width = 1;
+    using reg                      = int32_t;
+
+    static reg               splat(int32_t x)
+    {
+        return x;
+    }
+    // lane k holds base + k * step
+    static reg ramp(int32_t base, int32_t)
+    {
+        return base;
+    }
+    static reg add(reg a, reg b)
+    {
+        return a + b;
+    }
+    // bit k set if lane k of all three are <= 0
+    static uint32_t le_zero_mask(reg a, reg b, reg c)
+    {
+        return a <= 0 && b <= 0 && c <= 0;
+    }
+};
+
+template <> struct Lanes<ISA::SSE4>
+{
+    constexpr static int32_t width = 4;
+    using reg                      = __m128i;
+
+    SIMD_TARGET("sse4.1") static reg splat(int32_t x)
+    {
+        return _mm_set1_epi32(x);
+    }
+    SIMD_TARGET("sse4.1") static reg ramp(int32_t base, int32_t step)
+    {
+        return _mm_add_epi32(_mm_set1_epi32(base), _mm_mullo_epi32(_mm_set1_epi32(step), _mm_setr_epi32(0, 1, 2, 3)));
+    }
+    SIMD_TARGET("sse4.1") static reg add(reg a, reg b)
+    {
+        return _mm_add_epi32(a, b);
+    }
+    SIMD_TARGET("sse4.1") static uint32_t le_zero_mask(reg a, reg b, reg c)
+    {
+        // No integer <= compare before AVX-512, collect the lanes that are > 0 instead
+        auto zero    = _mm_setzero_si128();
+        auto outside = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(a, zero), _mm_cmpgt_epi32(b, zero)),
+                                    _mm_cmpgt_epi32(c, zero));
+        return ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0x0F;
+    }
+};
+
+template <> struct Lanes<ISA::AVX2>
+{
+    constexpr static int32_t width = 8;
+    using reg                      = __m256i;
+
+    SIMD_TARGET("avx2") static reg splat(int32_t x)
+    {
+        return _mm256_set1_epi32(x);
+    }
+    SIMD_TARGET("avx2") static reg ramp(int32_t base, int32_t step)
+    {
+        return _mm256_add_epi32(_mm256_set1_epi32(base), _mm256_mullo_epi32(_mm256_set1_epi32(step),
+                                                                            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    }
+    SIMD_TARGET("avx2") static reg add(reg a, reg b)
+    {
+        return _mm256_add_epi32(a, b);
+    }
+    SIMD_TARGET("avx2") static uint32_t le_zero_mask(reg a, reg b, reg c)
+    {
+        auto zero    = _mm256_setzero_si256();
+        auto outside = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(a, zero), _mm256_cmpgt_epi32(b, zero)),
+                                       _mm256_cmpgt_epi32(c, zero));
+        return ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+    }
+};
+
+template <> struct Lanes<ISA::AVX512>
+{
+    constexpr static int32_t width = 16;
+    using reg                      = __m512i;
+
+    SIMD_TARGET("avx512f") static reg splat(int32_t x)
+    {
+        return _mm512_set1_epi32(x);
+    }
+    SIMD_TARGET("avx512f") static reg ramp(int32_t base, int32_t step)
+    {
+        auto lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        return _mm512_add_epi32(_mm512_set1_epi32(base), _mm512_mullo_epi32(_mm512_set1_epi32(step), lane));
+    }
+    SIMD_TARGET("avx512f") static reg add(reg a, reg b)
+    {
+        return _mm512_add_epi32(a, b);
+    }
+    SIMD_TARGET("avx512f") static uint32_t le_zero_mask(reg a, reg b, reg c)
+    {
+        auto zero = _mm512_setzero_si512();
+        return _mm512_cmple_epi32_mask(a, zero) & _mm512_cmple_epi32_mask(b, zero) & _mm512_cmple_epi32_mask(c, zero);
+    }
+};
+
+// Edge function coverage of a horizontal span of at most 64 pixels
+// e1, e2, e3 are the three edge functions at the first pixel and d1, d2, d3 their increments per pixel
+// Bit j of the result is set when pixel j is inside the triangle (all edges <= 0)
+// Edge values are exact integers with the fill rule already folded in, so every width gives the same bits
+template <typename L>
+inline uint64_t EdgeCoverageSpan(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3, int32_t count)
+{
+    auto     a1      = L::ramp(e1, d1);
+    auto     a2      = L::ramp(e2, d2);
+    auto     a3      = L::ramp(e3, d3);
+    auto     inc1    = L::splat(d1 * L::width);
+    auto     inc2    = L::splat(d2 * L::width);
+    auto     inc3    = L::splat(d3 * L::width);
+
+    uint64_t covered = 0;
+    for (int32_t j = 0; j < count; j += L::width)
+    {
+        covered |= static_cast<uint64_t>(L::le_zero_mask(a1, a2, a3)) << j;
+        a1 = L::add(a1, inc1);
+        a2 = L::add(a2, inc2);
+        a3 = L::add(a3, inc3);
+    }
+    // Lanes past count belong to the neighbouring span
+    return count >= 64 ? covered : covered & ((uint64_t(1) << count) - 1);
+}
+
+
+static uint64_t CoverageScalar(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3, int32_t count)
+{
+    return EdgeCoverageSpan<Lanes<ISA::SCALAR>>(e1, e2, e3, d1, d2, d3, count);
+}
+
+SIMD_KERNEL("sse4.1")
+static uint64_t CoverageSSE4(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3, int32_t count)
+{
+    return EdgeCoverageSpan<Lanes<ISA::SSE4>>(e1, e2, e3, d1, d2, d3, count);
+}
+
+SIMD_KERNEL("avx2")
+static uint64_t CoverageAVX2(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3, int32_t count)
+{
+    return EdgeCoverageSpan<Lanes<ISA::AVX2>>(e1, e2, e3, d1, d2, d3, count);
+}
+
+SIMD_KERNEL("avx512f")
+static uint64_t CoverageAVX512(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3, int32_t count)
+{
+    return EdgeCoverageSpan<Lanes<ISA::AVX512>>(e1, e2, e3, d1, d2, d3, count);
+}
+
+// Ordered from the narrowest to the widest
+static SpanKernel const kernels[] = {
+    {ISA::SCALAR, "scalar", Lanes<ISA::SCALAR>::width, CoverageScalar},
+    {ISA::SSE4, "sse4", Lanes<ISA::SSE4>::width, CoverageSSE4},
+    {ISA::AVX2, "avx2", Lanes<ISA::AVX2>::width, CoverageAVX2},
+    {ISA::AVX512, "avx512", Lanes<ISA::AVX512>::width, CoverageAVX512},
+};
+
+static bool Supported(ISA isa)
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    switch (isa)
+    {
+    case ISA::SCALAR:
+        return true;
+    case ISA::SSE4:
+        return __builtin_cpu_supports("sse4.1");
+    case ISA::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ISA::AVX512:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse4 = info[2] & (1 << 19);
+    // Wide registers are only usable if the OS saves them on context switch
+    bool osxsave = info[2] & (1 << 27);
+    uint64_t xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(info, 7, 0);
+    bool avx2   = (info[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+    bool avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;
+    switch (isa)
+    {
+    case ISA::SCALAR:
+        return true;
+    case ISA::SSE4:
+        return sse4;
+    case ISA::AVX2:
+        return avx2;
+    case ISA::AVX512:
+        return avx512;
+    }
+    return false;
+#else
+    return isa == ISA::SCALAR;
+#endif
+}
+
+static SpanKernel SelectSpanKernel()
+{
+    auto cap = std::size(kernels) - 1;
+    if (auto env = std::getenv("RENDERER_SIMD"))
+    {
+        for (size_t i = 0; i < std::size(kernels); ++i)
+        {
+            if (!std::strcmp(env, kernels[i].name))
+                cap = i;
+        }
+    }
+
+    for (size_t i = cap + 1; i-- > 0;)
+    {
+        if (Supported(kernels[i].isa))
+            return kernels[i];
+    }
+    return kernels[0];
+}
+
+SpanKernel const &GetSpanKernel()
+{
+    static SpanKernel const kernel = SelectSpanKernel();
+    return kernel;
+}
+} // namespace SIMD
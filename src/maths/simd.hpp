@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Width agnostic SIMD layer
+// Vec4ss is fine for 4 component vector maths, but the edge function test of the rasterisers is a plain data parallel
+// integer loop over pixels that can use whatever register width the CPU offers
+// Kernels are written once against the Lanes<ISA> wrappers of simd.cpp and instantiated there per ISA, each compiled
+// for its own target. Wide register types never cross this header, callers only see plain function pointers
+// The binary itself only assumes the SSE4.1 baseline, the widest supported kernel is picked at runtime
+
+namespace SIMD
+{
+enum class ISA
+{
+    SCALAR,
+    SSE4,
+    AVX2,
+    AVX512
+};
+
+using SpanCoverageFn = uint64_t (*)(int32_t e1, int32_t e2, int32_t e3, int32_t d1, int32_t d2, int32_t d3,
+                                    int32_t count);
+
+struct SpanKernel
+{
+    ISA            isa;
+    const char    *name;
+    int32_t        width;
+    SpanCoverageFn coverage;
+};
+
+// Widest kernel supported by both the CPU and the OS
+// Setting RENDERER_SIMD to scalar, sse4, avx2 or avx512 caps the choice, handy to compare kernels on one machine
+SpanKernel const &GetSpanKernel();
+} // namespace SIMD
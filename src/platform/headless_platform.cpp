@@ -0,0 +1,143 @@
+#include "../include/platform.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Headless platform
+// No window, no compositor .. color buffer, depth buffer and shadow map are plain heap allocations
+// RendererMainLoop is driven for a fixed number of frames with a fixed deltaTime, so runs are repeatable
+// Usage : RenderHeadless [frames] [width] [height] [deltaTime] [output.ppm]
+
+static Platform platform;
+static uint64_t frames_swapped = 0;
+
+static void     SwapBuffers()
+{
+    // Nothing to present, just keep track of presented frames
+    frames_swapped++;
+}
+
+static void SetOpacity(float)
+{
+}
+
+static bool isKeyPressed(Keys)
+{
+    return false;
+}
+
+Platform GetCurrentPlatform()
+{
+    return platform;
+}
+
+static bool AllocateBuffers(uint32_t width, uint32_t height)
+{
+    platform.width                  = width;
+    platform.height                 = height;
+
+    platform.colorBuffer.width      = width;
+    platform.colorBuffer.height     = height;
+    platform.colorBuffer.noChannels = 4;
+    platform.colorBuffer.buffer =
+        static_cast<uint8_t *>(std::calloc(size_t(width) * height * platform.colorBuffer.noChannels, sizeof(uint8_t)));
+
+    platform.zBuffer.width    = width;
+    platform.zBuffer.height   = height;
+    platform.zBuffer.buffer   = static_cast<float *>(std::malloc(sizeof(float) * width * height));
+
+    platform.shadowMap.width  = width;
+    platform.shadowMap.height = height;
+    platform.shadowMap.buffer = static_cast<float *>(std::malloc(sizeof(float) * width * height));
+
+    // Checked in every build, the renderer would otherwise go on writing through null pointers
+    if (!platform.colorBuffer.buffer || !platform.zBuffer.buffer || !platform.shadowMap.buffer)
+    {
+        fprintf(stderr, "Failed to allocate the %ux%u framebuffers\n", width, height);
+        return false;
+    }
+    return true;
+}
+
+static void FreeBuffers()
+{
+    std::free(platform.colorBuffer.buffer);
+    std::free(platform.zBuffer.buffer);
+    std::free(platform.shadowMap.buffer);
+}
+
+// Dump the final color buffer as binary PPM, handy for image diffing the output of batch runs
+static bool WriteColorBuffer(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
+    auto const &cb = platform.colorBuffer;
+    fprintf(file, "P6\n%u %u\n255\n", cb.width, cb.height);
+    for (uint32_t h = 0; h < cb.height; ++h)
+    {
+        // Buffer is stored as BGRX
+        uint8_t *row = cb.buffer + h * cb.width * cb.noChannels;
+        for (uint32_t w = 0; w < cb.width; ++w)
+        {
+            uint8_t rgb[3] = {row[2], row[1], row[0]};
+            fwrite(rgb, sizeof(uint8_t), 3, file);
+            row += cb.noChannels;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t    frames     = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 300;
+    uint32_t    width      = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1280;
+    uint32_t    height     = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 720;
+    float       deltaTime  = argc > 4 ? std::strtof(argv[4], nullptr) : 1.0f / 60.0f;
+    const char *outputPath = argc > 5 ? argv[5] : nullptr;
+
+    if (!width || !height)
+    {
+        fprintf(stderr, "Invalid framebuffer dimension %ux%u\n", width, height);
+        return -1;
+    }
+
+    if (!AllocateBuffers(width, height))
+    {
+        FreeBuffers();
+        return -1;
+    }
+    platform.SwapBuffer  = SwapBuffers;
+    platform.SetOpacity  = SetOpacity;
+    platform.bKeyPressed = isKeyPressed;
+
+    // First call only initializes the scene
+    platform.deltaTime   = deltaTime;
+    RendererMainLoop(&platform);
+
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        // RendererMainLoop is allowed to scale deltaTime, so reset it every frame
+        platform.deltaTime = deltaTime;
+        RendererMainLoop(&platform);
+    }
+    auto   elapsed = duration<double>(steady_clock::now() - start).count();
+
+    double fps     = elapsed > 0.0 ? frames / elapsed : 0.0;
+    fprintf(stderr, "Rendered %u frames (%llu swapped) at %ux%u in %.3f s -> %.2f fps, %.3f ms/frame\n", frames,
+            (unsigned long long)frames_swapped, width, height, elapsed, fps, frames ? elapsed * 1000.0 / frames : 0.0);
+
+    if (outputPath)
+        WriteColorBuffer(outputPath);
+
+    FreeBuffers();
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "./job_system.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Jobs
+{
+bool PinCurrentThread(uint32_t core)
+{
+#if defined(_WIN32)
+    // Affinity masks only reach the first processor group
+    if (core >= 8 * sizeof(DWORD_PTR))
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+    if (core >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+SchedulerConfig ConfigFromEnvironment()
+{
+    SchedulerConfig config;
+    if (auto env = std::getenv("RENDERER_THREADS"))
+    {
+        auto threads = std::strtoul(env, nullptr, 10);
+        if (threads > 0)
+            config.workers = static_cast<uint32_t>(threads - 1);
+    }
+
+    if (auto env = std::getenv("RENDERER_AFFINITY"))
+    {
+        if (!std::strcmp(env, "compact"))
+        {
+            for (uint32_t i = 0; i <= config.workers; ++i)
+                config.cores.push_back(i);
+        }
+        else
+        {
+            for (char *end = env; *env; env = *end ? end + 1 : end)
+            {
+                auto core = std::strtoul(env, &end, 10);
+                if (end == env)
+                    break;
+                config.cores.push_back(static_cast<uint32_t>(core));
+            }
+        }
+    }
+    return config;
+}
+} // namespace Jobs
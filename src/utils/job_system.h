@@ -0,0 +1,393 @@
+#pragma once
+
+#include "./thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <immintrin.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Work stealing job system
+// Every worker owns a deque of jobs, it pushes and pops at the bottom while idle workers steal from the top of the
+// others. Jobs submitted from threads outside the system (the main thread) go through a shared queue instead
+// Workers that found nothing for a while park on an atomic wait, so an idle renderer doesn't burn any core
+// A thread waiting for a counter runs jobs meanwhile, so waiting on the main thread or inside a job never idles a core
+//
+// Jobs and counters are owned by the submitter and must outlive the jobs, the stack of the submitting function is the
+// usual place as that function waits for them anyway. Nothing is allocated per job
+
+namespace Jobs
+{
+using JobFuncPtr = void (*)(void *); // Same shape as the thread pool functions, void ptr to type erased arguments
+
+// Pins the calling thread to one logical core, false where that isn't supported or the core doesn't exist
+bool PinCurrentThread(uint32_t core);
+
+// One worker less than the hardware has, the thread that creates the scheduler runs jobs whenever it waits
+// hardware_concurrency may be 1, or 0 when unknown, both leave the creating thread alone
+inline uint32_t DefaultWorkerCount()
+{
+    auto threads = std::thread::hardware_concurrency();
+    return threads > 1 ? threads - 1 : 0;
+}
+
+struct SchedulerConfig
+{
+    uint32_t              workers = DefaultWorkerCount();
+    // Thread i runs on cores[i % cores.size()], thread 0 being the one creating the scheduler, nothing pinned if empty
+    std::vector<uint32_t> cores;
+};
+
+// RENDERER_THREADS sets the number of threads running jobs, the creating thread included
+// RENDERER_AFFINITY is a comma separated list of cores, or "compact" for thread i on core i
+SchedulerConfig ConfigFromEnvironment();
+
+class Counter;
+
+struct Job
+{
+    JobFuncPtr fn      = nullptr;
+    void      *args    = nullptr;
+    Counter   *counter = nullptr; // decremented once the job has run, set by submit
+    Job       *next    = nullptr; // link in the list of jobs waiting on a counter
+};
+
+// Number of jobs of a submission still to run
+// Jobs can be submitted to run after a counter is done, they are kept in a list on the counter until then
+// A counter may be reused once it has been waited on
+class Counter
+{
+    friend class Scheduler;
+
+    // waiting holds closed once the counter is done and the thread that finished it won't touch it anymore
+    static Job *closed()
+    {
+        return reinterpret_cast<Job *>(uintptr_t(1));
+    }
+
+    std::atomic<uint32_t> value{0};
+    std::atomic<Job *>    waiting{closed()};
+
+  public:
+    // Time the last job finished at, valid once done
+    std::chrono::steady_clock::time_point finished_at{};
+
+    bool                                  done() const
+    {
+        return waiting.load(std::memory_order_acquire) == closed();
+    }
+};
+
+// Chase-Lev deque of a fixed capacity, owner pushes and pops at the bottom, everyone else steals from the top
+class WorkStealingDeque
+{
+    constexpr static int64_t capacity = 1024;
+    static_assert((capacity & (capacity - 1)) == 0);
+
+    std::atomic<int64_t>     top{0};
+    std::atomic<int64_t>     bottom{0};
+    std::atomic<Job *>       items[capacity];
+
+  public:
+    // Owner only, false when full
+    bool push(Job *job)
+    {
+        auto b = bottom.load(std::memory_order_relaxed);
+        auto t = top.load(std::memory_order_acquire);
+        if (b - t >= capacity)
+            return false;
+        items[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+        // Publishes the job to the acquire load of bottom in steal
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner only
+    Job *pop()
+    {
+        auto b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job *job = items[b & (capacity - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // Last job, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread
+    Job *steal()
+    {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Job *job = items[t & (capacity - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+};
+
+class Scheduler
+{
+    // Rounds of searching for work before a worker parks, long enough to bridge the gaps between the passes of a frame
+    constexpr static uint32_t spin_rounds = 1024;
+
+    struct Worker
+    {
+        WorkStealingDeque deque;
+        std::thread       thread;
+    };
+
+    std::unique_ptr<Worker[]> workers;
+    uint32_t                  no_of_workers = 0;
+    // Jobs submitted from threads that aren't workers, or that didn't fit in the deque of the worker
+    // The ring takes them unless it is full, the locked list only takes what overflows
+    MPMCQueue<Job *, 4096>    injected;
+    LockedQueue<Job *>        overflow{};
+    std::atomic<uint32_t>     overflow_count{0}; // lets the search skip the lock of an empty list
+
+    std::atomic<bool>         running{true};
+    // Bumped whenever work shows up or a counter finishes, parked threads wait on it
+    std::atomic<uint32_t>     epoch{0};
+    std::atomic<uint32_t>     sleeping{0};
+
+    // Worker index of the current thread, or -1 outside the workers of this scheduler
+    static inline thread_local Scheduler *current_scheduler = nullptr;
+    static inline thread_local int32_t    current_worker    = -1;
+
+    int32_t                               worker_index() const
+    {
+        return current_scheduler == this ? current_worker : -1;
+    }
+
+    void wake()
+    {
+        // seq_cst like the park in help_until, with anything weaker both sides could read the value from before the
+        // other's write, the waker skipping the notify while the sleeper waits on the stale epoch
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst))
+            epoch.notify_all();
+    }
+
+    // Makes a list of jobs linked through next runnable
+    void enqueue(Job *list)
+    {
+        int32_t self = worker_index();
+        while (list)
+        {
+            Job *job = list;
+            list     = list->next;
+            if ((self < 0 || !workers[self].deque.push(job)) && !injected.push(job))
+            {
+                overflow.push(job);
+                overflow_count.fetch_add(1, std::memory_order_release);
+            }
+        }
+        wake();
+    }
+
+    Job *find_job(int32_t self)
+    {
+        Job *job = nullptr;
+        if (self >= 0 && (job = workers[self].deque.pop()))
+            return job;
+        if (injected.pop(job))
+            return job;
+        if (overflow_count.load(std::memory_order_acquire) && overflow.pop(job))
+        {
+            overflow_count.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+        // Start stealing right after ourselves, so thieves spread over the victims
+        for (uint32_t i = 1; i <= no_of_workers; ++i)
+        {
+            auto victim = (self + i) % no_of_workers;
+            if (victim != uint32_t(self) && (job = workers[victim].deque.steal()))
+                return job;
+        }
+        return nullptr;
+    }
+
+    void execute(Job *job)
+    {
+        Counter *counter = job->counter;
+        job->fn(job->args);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            counter->finished_at = std::chrono::steady_clock::now();
+            // The counter may be gone as soon as it reads closed, nothing touches it after the exchange
+            Job *list            = counter->waiting.exchange(Counter::closed(), std::memory_order_acq_rel);
+            if (list)
+                enqueue(list);
+            else
+                wake();
+        }
+    }
+
+    // Runs jobs until done() returns true, parks when there is nothing to run
+    template <typename Done> void help_until(int32_t self, Done &&done)
+    {
+        uint32_t idle = 0;
+        while (!done())
+        {
+            auto seen = epoch.load(std::memory_order_acquire);
+            if (Job *job = find_job(self))
+            {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            if (++idle < spin_rounds)
+            {
+                _mm_pause();
+                continue;
+            }
+            // Anything submitted or finished after seen was read bumps the epoch. Announcing the sleeper and reading
+            // the epoch are both seq_cst, as are bumping the epoch and reading sleeping in wake, so either this wait
+            // sees the new epoch or wake sees the sleeper and notifies
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            if (!done())
+                epoch.wait(seen, std::memory_order_seq_cst);
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            idle = 0;
+        }
+    }
+
+    void worker_thread_func(uint32_t index, int32_t core)
+    {
+        if (core >= 0)
+            PinCurrentThread(core);
+        current_scheduler = this;
+        current_worker    = index;
+        help_until(index, [this] { return !running.load(std::memory_order_acquire); });
+    }
+
+  public:
+    explicit Scheduler(SchedulerConfig const &config)
+        : workers{new Worker[config.workers]}, no_of_workers{config.workers}
+    {
+        auto core = [&config](uint32_t thread) {
+            return config.cores.empty() ? -1 : int32_t(config.cores[thread % config.cores.size()]);
+        };
+        if (core(0) >= 0)
+            PinCurrentThread(core(0));
+        for (uint32_t i = 0; i < no_of_workers; ++i)
+            workers[i].thread = std::thread{&Scheduler::worker_thread_func, this, i, core(i + 1)};
+    }
+
+    explicit Scheduler(uint32_t no_of_workers) : Scheduler{SchedulerConfig{.workers = no_of_workers}}
+    {
+    }
+
+    Scheduler(Scheduler const &)            = delete;
+    Scheduler &operator=(Scheduler const &) = delete;
+
+    uint32_t   worker_count() const
+    {
+        return no_of_workers;
+    }
+
+    // Threads running jobs, workers and the thread that waits
+    uint32_t thread_count() const
+    {
+        return no_of_workers + 1;
+    }
+
+    // Runs count jobs, counter is done once all of them have run
+    // With after, the jobs are held back until that counter is done
+    void submit(Job *jobs, uint32_t count, Counter &counter, Counter *after = nullptr)
+    {
+        if (!count)
+            return;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            jobs[i].counter = &counter;
+            jobs[i].next    = i + 1 < count ? &jobs[i + 1] : nullptr;
+        }
+        // The first submission to an idle counter opens it, its jobs aren't runnable yet so it can't close meanwhile
+        if (counter.value.fetch_add(count, std::memory_order_acq_rel) == 0)
+            counter.waiting.store(nullptr, std::memory_order_release);
+
+        if (after)
+        {
+            auto head = after->waiting.load(std::memory_order_acquire);
+            while (head != Counter::closed())
+            {
+                jobs[count - 1].next = head;
+                if (after->waiting.compare_exchange_weak(head, jobs, std::memory_order_acq_rel))
+                    return;
+            }
+            jobs[count - 1].next = nullptr;
+        }
+        enqueue(jobs);
+    }
+
+    // Runs jobs on the calling thread until counter is done
+    void wait(Counter const &counter)
+    {
+        help_until(worker_index(), [&counter] { return counter.done(); });
+    }
+
+    // Calls fn(first, last) over [begin, end) split in chunks of at least grain, on all the workers and the caller
+    template <typename Fn> void parallel_for(size_t begin, size_t end, size_t grain, Fn const &fn)
+    {
+        constexpr size_t max_chunks = 64;
+        if (end <= begin)
+            return;
+        size_t count  = end - begin;
+        // A few chunks per thread leave room for stealing when some chunks take longer
+        size_t chunks = vMin<size_t>((count + vMax<size_t>(grain, 1) - 1) / vMax<size_t>(grain, 1),
+                                     4 * (no_of_workers + 1), max_chunks);
+        if (chunks <= 1)
+        {
+            fn(begin, end);
+            return;
+        }
+
+        struct Chunk
+        {
+            Fn const *fn;
+            size_t    first, last;
+        };
+        Chunk   args[max_chunks];
+        Job     jobs[max_chunks];
+        Counter counter;
+        for (size_t i = 0; i < chunks; ++i)
+        {
+            args[i] = Chunk{&fn, begin + count * i / chunks, begin + count * (i + 1) / chunks};
+            jobs[i] = Job{[](void *arg) {
+                              auto chunk = static_cast<Chunk *>(arg);
+                              (*chunk->fn)(chunk->first, chunk->last);
+                          },
+                          &args[i]};
+        }
+        submit(jobs, static_cast<uint32_t>(chunks), counter);
+        wait(counter);
+    }
+
+    ~Scheduler()
+    {
+        running.store(false, std::memory_order_release);
+        wake();
+        for (uint32_t i = 0; i < no_of_workers; ++i)
+            workers[i].thread.join();
+    }
+};
+} // namespace Jobs
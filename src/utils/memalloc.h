@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <malloc.h>
+#include <new>
 #include <memory>
 #include <mutex>
+#include <utility>
 #include <vector>
 
 // Procedures for aligment of memory address to the 2^k boundary
@@ -14,29 +20,138 @@ constexpr size_t align(size_t val, uint32_t align)
     return (val + align - 1) & ~size_t(align - 1);
 }
 
+// Frame arena, allocations bump a pointer through a list of chunks and are all released together by reset()
+// A chunk that runs out links the next one, the chunks are kept across resets so once the arena has grown to the
+// largest frame seen, later frames don't call malloc at all
 class MonotonicMemoryResource
 {
-    void  *buffer;
-    size_t capacity;
-    size_t size = 0;
+    struct Chunk
+    {
+        Chunk *next;
+        size_t capacity;
+
+        uint8_t *data()
+        {
+            return reinterpret_cast<uint8_t *>(this) + header;
+        }
+    };
+    static constexpr size_t header = align(sizeof(Chunk), alignof(std::max_align_t));
 
   public:
-    MonotonicMemoryResource() : buffer{nullptr}, capacity(0)
+    static constexpr size_t default_chunk_size = 1024 * 1024;
+
+    // Usage of the last frame ended by end_frame()
+    struct Statistics
+    {
+        size_t   high_water       = 0; // Most bytes in use at once, alignment padding and skipped chunk tails included
+        size_t   reserved         = 0; // Bytes held by all the chunks
+        uint32_t chunks           = 0; // Chunks linked by the arena
+        uint32_t chunks_allocated = 0; // Chunks malloc'd during the frame, zero once the arena has settled
+    };
+
+  private:
+    Chunk     *head       = nullptr;
+    Chunk     *current    = nullptr;
+    size_t     offset     = 0; // into the current chunk
+    size_t     used       = 0; // bytes of the chunks before the current one that were in use since the last reset
+    size_t     chunk_size = default_chunk_size;
+    size_t     reserved   = 0;
+    uint32_t   chunks     = 0;
+    size_t     frame_high_water       = 0;
+    uint32_t   frame_chunks_allocated = 0;
+    Statistics last_frame;
+
+    Chunk *link_chunk(size_t min_capacity)
     {
+        auto capacity = std::max(chunk_size, min_capacity);
+        auto chunk    = static_cast<Chunk *>(std::malloc(header + capacity));
+        if (!chunk)
+            throw std::bad_alloc();
+        chunk->capacity = capacity;
+        // Insert after the current chunk, a too small retained chunk further down is still used later
+        chunk->next = current ? current->next : nullptr;
+        (current ? current->next : head) = chunk;
+        reserved += capacity;
+        chunks++;
+        frame_chunks_allocated++;
+        return chunk;
     }
 
-    MonotonicMemoryResource(void *buffer, size_t capacity) : buffer{buffer}, capacity{capacity}
+    void release()
     {
+        while (head)
+            std::free(std::exchange(head, head->next));
+        current = nullptr;
     }
 
-    void *allocate(size_t alloc_size)
+  public:
+    MonotonicMemoryResource() = default;
+
+    explicit MonotonicMemoryResource(size_t chunk_size) : chunk_size{chunk_size}
     {
-        auto to_return = static_cast<void *>(static_cast<uint8_t *>(buffer) + size);
-        if (size + alloc_size >= capacity)
-            return nullptr;
+        current                = link_chunk(chunk_size);
+        frame_chunks_allocated = 0;
+    }
+
+    MonotonicMemoryResource(MonotonicMemoryResource const &)            = delete;
+    MonotonicMemoryResource &operator=(MonotonicMemoryResource const &) = delete;
+
+    MonotonicMemoryResource(MonotonicMemoryResource &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MonotonicMemoryResource &operator=(MonotonicMemoryResource &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            head                   = std::exchange(other.head, nullptr);
+            current                = std::exchange(other.current, nullptr);
+            offset                 = std::exchange(other.offset, 0);
+            used                   = std::exchange(other.used, 0);
+            chunk_size             = other.chunk_size;
+            reserved               = std::exchange(other.reserved, 0);
+            chunks                 = std::exchange(other.chunks, 0);
+            frame_high_water       = std::exchange(other.frame_high_water, 0);
+            frame_chunks_allocated = std::exchange(other.frame_chunks_allocated, 0);
+            last_frame             = std::exchange(other.last_frame, Statistics{});
+        }
+        return *this;
+    }
+
+    ~MonotonicMemoryResource()
+    {
+        release();
+    }
 
-        size += alloc_size;
-        return to_return;
+    // alignment must be a power of two
+    void *allocate(size_t alloc_size, size_t alignment = alignof(std::max_align_t))
+    {
+        assert(alignment && !(alignment & (alignment - 1)));
+        for (;;)
+        {
+            if (current)
+            {
+                auto base  = reinterpret_cast<uintptr_t>(current->data());
+                auto start = align(base + offset, static_cast<uint32_t>(alignment)) - base;
+                if (start + alloc_size <= current->capacity)
+                {
+                    offset = start + alloc_size;
+                    return current->data() + start;
+                }
+                // The tail of this chunk stays unused until the next reset
+                used += current->capacity;
+                if (current->next && current->next->capacity >= alloc_size + alignment)
+                {
+                    current = current->next;
+                    offset  = 0;
+                    continue;
+                }
+            }
+            current = link_chunk(alloc_size + alignment);
+            offset  = 0;
+        }
     }
 
     void deallocate(size_t size)
@@ -44,9 +159,27 @@ class MonotonicMemoryResource
         // don't do anything
     }
 
+    // Releases every allocation in O(1), the chunks are kept for reuse
     void reset()
     {
-        size = 0;
+        frame_high_water = std::max(frame_high_water, used + offset);
+        current          = head;
+        offset           = 0;
+        used             = 0;
+    }
+
+    // Resets and closes the statistics of the frame, called once per frame by the renderer
+    void end_frame()
+    {
+        reset();
+        last_frame             = Statistics{frame_high_water, reserved, chunks, frame_chunks_allocated};
+        frame_high_water       = 0;
+        frame_chunks_allocated = 0;
+    }
+
+    Statistics const &statistics() const
+    {
+        return last_frame;
     }
 };
 
@@ -109,6 +242,8 @@ template <typename T> class MemAlloc
   public:
     MonotonicMemoryResource *resource;
     using value_type     = T;
+    // A container assigned a fresh one moves over to its arena, instead of keeping the arena it had
+    using propagate_on_container_move_assignment = std::true_type;
 
     constexpr MemAlloc() = default;
     constexpr MemAlloc(MonotonicMemoryResource *resource) noexcept : resource{resource}
@@ -123,8 +258,8 @@ template <typename T> class MemAlloc
 
     [[nodiscard]] T *allocate(std::size_t n)
     {
-        auto             ptr = resource->allocate(n * sizeof(T));
-        return new (ptr) T[n];
+        // Storage only, the container constructs the elements
+        return static_cast<T *>(resource->allocate(n * sizeof(T), alignof(T)));
     }
 
     void deallocate(T *p, std::size_t n) noexcept
@@ -142,6 +277,30 @@ bool operator==(const MemAlloc<T>&, const MemAlloc<U>&) { return true; }
 template<class T, class U>
 bool operator!=(const MemAlloc<T>&, const MemAlloc<U>&) { return false; }
 
+// Allocator whose resize default initialises instead of value initialising, trivial elements are left untouched
+// Pages of a large buffer are then placed by whichever thread writes them first, which on NUMA machines is the node
+// of that thread
+template <typename T> class DefaultInitAllocator : public std::allocator<T>
+{
+  public:
+    template <typename U> struct rebind
+    {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    using std::allocator<T>::allocator;
+
+    template <typename U> void construct(U *ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void *>(ptr)) U;
+    }
+
+    template <typename U, typename... Args> void construct(U *ptr, Args &&...args)
+    {
+        ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
 // Definition of mutex obj
 // template <typename T>
 // std::mutex MemAlloc<T>::mut = {};
@@ -1,85 +1,291 @@
 #include "./parallel_render.h"
 #include "../include/shader.h"
+#include "../include/texture_manager.h"
+#include "../maths/simd.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
 
 extern RLights get_light_source();
 // Retrieves the current light and eye position
 extern Vec3f   get_camera_position();
 
 constexpr bool cast_shadow = false;
-// Lets use some template stuffs to control code branching instead of macro definitions
-namespace Parallel
+
+// Triangle setup shared by the main and the shadow rasteriser
+// Vertices are in 28.4 fixed point and pixels are sampled at integer positions, so edge functions are exact integers
+// A pixel is covered when it's strictly inside all three edges, or lies exactly on a top or a left edge
+// An edge shared by two triangles is then drawn by exactly one of them, whatever the order, tile or thread
+struct TriangleEdges
 {
-using namespace Pipeline3D;
-static void Rasteriser(Pipeline3D::RasterInfo const &v0, Pipeline3D::RasterInfo const &v1,
-                       Pipeline3D::RasterInfo const &v2, int32_t XMinBound, int32_t XMaxBound)
+    int32_t       minX, maxX, minY, maxY; // pixels to walk, bounding box clipped to the bounds given at setup
+    Vec2<int32_t> d[3];                   // edge i goes from vertex i to the next, x step adds d.y, y step adds -d.x
+    int32_t       e[3];                   // coverage values at (minX, minY), fill rule included, covered if all <= 0
+    float         offset[3];              // e + offset is the real edge function, used for interpolation
+    float         area;                   // in the units of e + offset, only negative area is ever set up
+};
+
+static bool SetupEdges(Pipeline3D::RasterInfo const &v0, Pipeline3D::RasterInfo const &v1,
+                       Pipeline3D::RasterInfo const &v2, int32_t XMinBound, int32_t XMaxBound, int32_t YMinBound,
+                       int32_t YMaxBound, TriangleEdges &edges)
 {
-    auto            light     = get_light_source();
-    auto            cameraPos = get_camera_position();
-    constexpr float shiny     = 32.0f;
-    // Yup .. Now ready for flat shading
-    // the depth map somehow here
-    // Next smooth shading
-    Platform platform = GetCurrentPlatform();
-
-    auto     Device   = GetRasteriserDevice();
-    int32_t  minX     = vMax(vMin(v0.x, v1.x, v2.x), XMinBound);
-    int32_t  maxX     = vMin(vMax(v0.x, v1.x, v2.x), XMaxBound);
-    /*int      minX     = std::min(std::min(v0.x, v1.x, v2.x), XMaxBound);
-    int      maxX     = std::min(std::max(v0.x, v1.x, v2.x), XMinBound);*/
+    using Parallel::subpixel_bits;
+    using Parallel::subpixel_one;
+
+    Pipeline3D::RasterInfo const *v[3] = {&v0, &v1, &v2};
+    for (int i = 0; i < 3; ++i)
+        edges.d[i] = Vec2<int32_t>(v[(i + 1) % 3]->x - v[i]->x, v[(i + 1) % 3]->y - v[i]->y);
+
+    auto const &d0   = edges.d[0];
+    auto const &d1   = edges.d[1];
+    // 24.8 products don't fit in 32 bits
+    int64_t     area = int64_t(d1.x) * d0.y - int64_t(d0.x) * d1.y;
+    if (area >= 0)
+        return false;
+
+    // First and last pixel positions inside the fixed point bounding box
+    edges.minX = vMax((vMin(v0.x, v1.x, v2.x) + subpixel_one - 1) >> subpixel_bits, XMinBound);
+    edges.maxX = vMin(vMax(v0.x, v1.x, v2.x) >> subpixel_bits, XMaxBound);
+    edges.minY = vMax((vMin(v0.y, v1.y, v2.y) + subpixel_one - 1) >> subpixel_bits, YMinBound);
+    edges.maxY = vMin(vMax(v0.y, v1.y, v2.y) >> subpixel_bits, YMaxBound);
+    if (edges.minX > edges.maxX || edges.minY > edges.maxY)
+        return false;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto const &d        = edges.d[i];
+        // Edge function at pixel (w, h) is 16 * (w * d.y - h * d.x) + c
+        int64_t     c        = int64_t(v[i]->y) * d.x - int64_t(v[i]->x) * d.y;
+        // Pixels on an edge that isn't top-left must fail, for integers that is E + 1 <= 0
+        bool        top_left = d.y < 0 || (d.y == 0 && d.x < 0);
+        // 16 * F + c + bias <= 0 <=> F <= floor(-(c + bias) / 16), with F the pixel part of the edge function
+        // Folding that threshold in drops the sub-pixel part and the fill rule becomes a plain <= 0 test
+        int64_t     t        = -(c + (top_left ? 0 : 1)) >> subpixel_bits;
+        edges.e[i]           = static_cast<int32_t>(int64_t(edges.minX) * d.y - int64_t(edges.minY) * d.x - t);
+        edges.offset[i]      = static_cast<float>(t + static_cast<double>(c) / subpixel_one);
+    }
+    edges.area = static_cast<float>(static_cast<double>(area) / subpixel_one);
+    return true;
+}
 
-    int minY = vMin(v0.y, v1.y, v2.y);
-    int maxY = vMax(v0.y, v1.y, v2.y);
+// Fragments of a group of 4 horizontally adjacent pixels, lane k being pixel x + k
+// b0, b1 and b2 are the barycentrics of v0, v1 and v2, not yet divided by the area, z the interpolated depth
+struct QuadFragments
+{
+    __m128   b0, b1, b2;
+    __m128   z;
+    uint32_t inside; // lanes inside the span, the others may belong to another tile or lie past the end of the buffer
+};
 
-    // Assume vectors are in clockwise ordering
-    Vec2  p0   = Vec2(v1.x, v1.y) - Vec2(v0.x, v0.y);
-    Vec2  p1   = Vec2(v2.x, v2.y) - Vec2(v1.x, v1.y);
-    Vec2  p2   = Vec2(v0.x, v0.y) - Vec2(v2.x, v2.y);
+// All bits of lane k set if bit k of mask is
+static __m128 LaneMask(uint32_t mask)
+{
+    auto bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits));
+}
 
-    Vec2  vec0 = Vec2(v0.x, v0.y);
-    Vec2  vec1 = Vec2(v1.x, v1.y);
-    Vec2  vec2 = Vec2(v2.x, v2.y);
+// Walks the triangle 4 pixels at a time and calls quad(x, h, mask, fragments) for each group of 4 adjacent pixels
+// of which at least one is covered and passes the depth test, bit k of mask being set for those
+// Coverage is resolved by the runtime selected SIMD kernel, 64 pixels of a row at a time. Barycentrics, depth and the
+// depth test are then done for a whole group at once, and the depth of the passing fragments is written back here
+// Barycentrics are converted from the exact edge values of each pixel, so they don't depend on where the walk started
+// zplane holds the depth of v0, v1 and v2 divided by the area
+// With tile_depth the walk must stay inside that tile. Blocks whose bound isn't behind zmin, the nearest depth of the
+// triangle, are skipped and the bounds of the blocks written to are refreshed at the end
+template <typename Quad>
+static void ForEachCoveredQuad(TriangleEdges const &edges, Vec3f const &zplane, float *depth_buffer,
+                               int32_t depth_width, Parallel::TileDepth *tile_depth, float zmin,
+                               Parallel::PipelineStatistics *stats, Quad &&quad)
+{
+    using Parallel::depth_block_size;
+    using Parallel::tile_blocks;
+
+    constexpr int32_t span   = 64;
+    auto const       &kernel = SIMD::GetSpanKernel();
+    auto const       &p0     = edges.d[0];
+    auto const       &p1     = edges.d[1];
+    auto const       &p2     = edges.d[2];
+
+    // Edge i is the one opposite to vertex (i + 2) % 3
+    auto              off0   = _mm_set1_ps(edges.offset[1]);
+    auto              off1   = _mm_set1_ps(edges.offset[2]);
+    auto              off2   = _mm_set1_ps(edges.offset[0]);
+    auto              z0     = _mm_set1_ps(zplane.x);
+    auto              z1     = _mm_set1_ps(zplane.y);
+    auto              z2     = _mm_set1_ps(zplane.z);
+    auto              lane   = _mm_setr_epi32(0, 1, 2, 3);
+    auto              inc_a1 = _mm_set1_epi32(4 * p0.y);
+    auto              inc_a2 = _mm_set1_epi32(4 * p1.y);
+    auto              inc_a3 = _mm_set1_epi32(4 * p2.y);
+
+    int32_t           e1_row = edges.e[0];
+    int32_t           e2_row = edges.e[1];
+    int32_t           e3_row = edges.e[2];
+    uint64_t          dirty  = 0;
+    for (int32_t h = edges.minY; h <= edges.maxY; ++h)
+    {
+        for (int32_t x = edges.minX; x <= edges.maxX; x += span)
+        {
+            int32_t  count   = vMin(span, edges.maxX - x + 1);
+            uint64_t visible = ~uint64_t(0);
+            if (tile_depth)
+            {
+                int32_t by         = (h - tile_depth->y0) / depth_block_size;
+                // Count each block once, on the first row the walk visits it
+                bool    first_row  = h == edges.minY || (h - tile_depth->y0) % depth_block_size == 0;
+                int32_t first_bx   = (x - tile_depth->x0) / depth_block_size;
+                int32_t last_bx    = (x + count - 1 - tile_depth->x0) / depth_block_size;
+                visible            = 0;
+                for (int32_t bx = first_bx; bx <= last_bx; ++bx)
+                {
+                    if (zmin < tile_depth->block(bx, by))
+                    {
+                        int32_t first = vMax(tile_depth->x0 + bx * depth_block_size, x) - x;
+                        int32_t last  = vMin(tile_depth->x0 + (bx + 1) * depth_block_size - 1, x + count - 1) - x;
+                        visible |= (~uint64_t(0) >> (63 - last)) & (~uint64_t(0) << first);
+                    }
+                    else if (stats && first_row)
+                        stats->depth_blocks_culled++;
+                }
+                if (!visible)
+                    continue;
+            }
 
-    float area = Vec2<int>::Determinant(p1, p0);
+            int32_t  e1      = e1_row + (x - edges.minX) * p0.y;
+            int32_t  e2      = e2_row + (x - edges.minX) * p1.y;
+            int32_t  e3      = e3_row + (x - edges.minX) * p2.y;
+            uint64_t covered = kernel.coverage(e1, e2, e3, p0.y, p1.y, p2.y, count) & visible;
+            if (stats)
+            {
+                stats->blocks_tested += (count + kernel.width - 1) / kernel.width;
+                stats->fragments_covered += std::popcount(covered);
+            }
 
-    // Perspective depth interpolation, perspective correct texture interpolation ....
-    Vec2 point = Vec2(minX, minY);
-    // Start collecting points from here
+            auto a1i = _mm_add_epi32(_mm_set1_epi32(e1), _mm_mullo_epi32(_mm_set1_epi32(p0.y), lane));
+            auto a2i = _mm_add_epi32(_mm_set1_epi32(e2), _mm_mullo_epi32(_mm_set1_epi32(p1.y), lane));
+            auto a3i = _mm_add_epi32(_mm_set1_epi32(e3), _mm_mullo_epi32(_mm_set1_epi32(p2.y), lane));
+            for (int32_t q = 0; q < count; q += 4)
+            {
+                uint32_t mask = (covered >> q) & 0x0F;
+                if (mask)
+                {
+                    QuadFragments f;
+                    f.inside     = q + 4 <= count ? 0x0F : (1u << (count - q)) - 1;
+                    f.b0         = _mm_add_ps(_mm_cvtepi32_ps(a2i), off0);
+                    f.b1         = _mm_add_ps(_mm_cvtepi32_ps(a3i), off1);
+                    f.b2         = _mm_add_ps(_mm_cvtepi32_ps(a1i), off2);
+                    f.z          = _mm_add_ps(_mm_add_ps(_mm_mul_ps(f.b0, z0), _mm_mul_ps(f.b1, z1)),
+                                              _mm_mul_ps(f.b2, z2));
+
+                    // Only a group entirely inside the span is loaded and stored at once
+                    float *depth = depth_buffer + h * depth_width + x + q;
+                    bool   full  = f.inside == 0x0F;
+                    __m128 old;
+                    if (full)
+                        old = _mm_loadu_ps(depth);
+                    else
+                    {
+                        alignas(16) float d[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                        for (int32_t k = 0; k < count - q; ++k)
+                            d[k] = depth[k];
+                        old = _mm_load_ps(d);
+                    }
+                    auto pass = _mm_cmplt_ps(f.z, old);
+                    mask &= _mm_movemask_ps(pass);
+                    if (mask)
+                    {
+                        if (stats)
+                            stats->fragments_passed_depth += std::popcount(mask);
+                        if (tile_depth)
+                        {
+                            for (uint32_t m = mask; m; m &= m - 1)
+                            {
+                                int32_t w = x + q + std::countr_zero(m);
+                                dirty |= uint64_t(1) << ((h - tile_depth->y0) / depth_block_size * tile_blocks +
+                                                         (w - tile_depth->x0) / depth_block_size);
+                            }
+                        }
 
-    float a1_ = Vec2<int32_t>::Determinant(point - vec0, p0);
-    float a2_ = Vec2<int32_t>::Determinant(point - vec1, p1);
-    float a3_ = Vec2<int32_t>::Determinant(point - vec2, p2);
+                        quad(x + q, h, mask, f);
 
-    // Read to process 4 pixels at a time
-    SIMD::Vec4ss a1_vec  = SIMD::Vec4ss(a1_, a1_ + p0.y, a1_ + 2 * p0.y, a1_ + 3 * p0.y);
-    SIMD::Vec4ss a2_vec  = SIMD::Vec4ss(a2_, a2_ + p1.y, a2_ + 2 * p1.y, a2_ + 3 * p1.y);
-    SIMD::Vec4ss a3_vec  = SIMD::Vec4ss(a3_, a3_ + p2.y, a3_ + 2 * p2.y, a3_ + 3 * p2.y);
+                        if (full)
+                            _mm_storeu_ps(depth, _mm_blendv_ps(old, f.z, LaneMask(mask)));
+                        else
+                        {
+                            alignas(16) float z[4];
+                            _mm_store_ps(z, f.z);
+                            for (uint32_t m = mask; m; m &= m - 1)
+                                depth[std::countr_zero(m)] = z[std::countr_zero(m)];
+                        }
+                    }
+                }
+                a1i = _mm_add_epi32(a1i, inc_a1);
+                a2i = _mm_add_epi32(a2i, inc_a2);
+                a3i = _mm_add_epi32(a3i, inc_a3);
+            }
+        }
+        e1_row = e1_row - p0.x;
+        e2_row = e2_row - p1.x;
+        e3_row = e3_row - p2.x;
+    }
 
-    SIMD::Vec4ss inc_a1  = SIMD::Vec4ss(4 * p0.y);
-    SIMD::Vec4ss inc_a2  = SIMD::Vec4ss(4 * p1.y);
-    SIMD::Vec4ss inc_a3  = SIMD::Vec4ss(4 * p2.y);
+    if (tile_depth)
+        tile_depth->refresh(dirty, depth_buffer, depth_width);
+}
 
-    SIMD::Vec4ss inc_a1_ = SIMD::Vec4ss(-p0.x);
-    SIMD::Vec4ss inc_a2_ = SIMD::Vec4ss(-p1.x);
-    SIMD::Vec4ss inc_a3_ = SIMD::Vec4ss(-p2.x);
+// Lets use some template stuffs to control code branching instead of macro definitions
+namespace Parallel
+{
+using namespace Pipeline3D;
+// Per triangle shading constants, shared by the forward rasteriser and the deferred resolve
+struct TriangleShading
+{
+    BinnedTriangle const *tri;
+    Vec3f                 normal;
+    float                 shade;
+    Vec4f                 shadowPos0, shadowPos1, shadowPos2;
+    Texture const        *texture;
+    TextureSampler        sampler;
+    // Screen space derivatives of sum(w_i * uv_i) and sum(w_i), w_i being the perspective weights of ShadeFragment
+    Vec2f                 uv_dx, uv_dy;
+    float                 w_dx, w_dy;
+};
+
+static Texture const &MissingTexture()
+{
+    static uint8_t white[3] = {0xFF, 0xFF, 0xFF};
+    static Texture missing  = [] {
+        Texture texture{};
+        texture.raw_data  = white;
+        texture.width     = 1;
+        texture.height    = 1;
+        texture.channels  = 3;
+        texture.bit_depth = 8;
+        texture.GenerateMips();
+        return texture;
+    }();
+    return missing;
+}
 
-    SIMD::Vec4ss a1, a2, a3;
-    SIMD::Vec4ss zvec(v0.z / area, v1.z / area, v2.z / area, 0.0f);
-    // zvec = zvec;
-    // Now processing downwards
-    auto          inv_w     = SIMD::Vec4ss(v0.inv_w / area, v1.inv_w / area, v2.inv_w / area, 0.0f);
-    constexpr int hStepSize = 4;
+static void SetupShading(FrameUniforms const &uniforms, BinnedTriangle const &tri, TriangleShading &shading)
+{
+    auto const &v0 = tri.v0;
+    auto const &v1 = tri.v1;
+    auto const &v2 = tri.v2;
+    shading.tri    = &tri;
 
     // Calculate the outward normal vector
-    Vec3f dir0 = Vec3f(v0.frag_pos);
-    Vec3f dir1 = Vec3f(v1.frag_pos);
-    Vec3f dir2 = Vec3f(v2.frag_pos);
+    Vec3f dir0     = Vec3f(v0.frag_pos);
+    Vec3f dir1     = Vec3f(v1.frag_pos);
+    Vec3f dir2     = Vec3f(v2.frag_pos);
 
     // Assuming clockwise ordering we have,
     // Flat shading
-    auto normal   = Vec3f::Cross(dir1 - dir0, dir2 - dir1);
-    auto centroid = (v0.frag_pos + v1.frag_pos + v2.frag_pos) * (1.0f / 3.0f);
-    auto flat     = normal.unit().dot((Vec3f(light.position) - centroid).unit());
-    auto shade    = vMax(0.0f, flat) * 0.9f;
+    shading.normal = Vec3f::Cross(dir1 - dir0, dir2 - dir1);
+    auto centroid  = (v0.frag_pos + v1.frag_pos + v2.frag_pos) * (1.0f / 3.0f);
+    auto flat      = shading.normal.unit().dot((Vec3f(uniforms.light.position) - centroid).unit());
+    shading.shade  = vMax(0.0f, flat) * uniforms.diffuse;
     // Not going to implement Gouraud shading -> In Gouraud shading lighting information are calculated at each vertex
     // and barycentric interpolated to each fragment pos
     //
@@ -92,540 +298,548 @@ static void Rasteriser(Pipeline3D::RasterInfo const &v0, Pipeline3D::RasterInfo
     // normals are same, we don't need that interpolation here We interpolating frag pos instead and calculate the
     // directional impact, ambient contribution and phong specular on pex pixel basis
 
-    // Now to the depth mapping
-    auto lightOrtho = OrthoProjection(-5.0f, 5.0f, -5.0f, 5.0f, -5.0f, 5.0f);
-    // clashes with SIMD lookAtMatrix
-    auto lightView  = ::lookAtMatrix(light.position, Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
-
-    auto shadowPos0 = lightOrtho * lightView * v0.frag_pos;
-    auto shadowPos1 = lightOrtho * lightView * v1.frag_pos;
-    auto shadowPos2 = lightOrtho * lightView * v2.frag_pos;
-
-    // calculate lightPos
-    if (Device->Context.ActiveMergeMode == RenderDevice::MergeMode::COLOR_MODE)
+    if (tri.merge_mode != RenderDevice::MergeMode::COLOR_MODE)
     {
-        for (size_t h = minY; h <= maxY; ++h)
+        shading.shadowPos0 = uniforms.lightTransform * v0.frag_pos;
+        shading.shadowPos1 = uniforms.lightTransform * v1.frag_pos;
+        shading.shadowPos2 = uniforms.lightTransform * v2.frag_pos;
+        // Do depth mapping for textured floor for now
+        shading.texture    = GetTexture(tri.textureID);
+        // Textures that couldn't be loaded again after an eviction come out plain white
+        if (!shading.texture || !shading.texture->mips)
+            shading.texture = &MissingTexture();
+        shading.sampler = shading.texture->Bind();
+
+        // Barycentric i is the edge function of the edge opposite to vertex i over the area, it steps by d.y along x
+        // and by -d.x along y
+        RasterInfo const *v[3] = {&v0, &v1, &v2};
+        Vec2<int32_t>     d[3];
+        for (int i = 0; i < 3; ++i)
+            d[i] = Vec2<int32_t>(v[(i + 1) % 3]->x - v[i]->x, v[(i + 1) % 3]->y - v[i]->y);
+        float area    = static_cast<float>(int64_t(d[1].x) * d[0].y - int64_t(d[0].x) * d[1].y) / subpixel_one;
+        shading.uv_dx = shading.uv_dy = Vec2f(0.0f, 0.0f);
+        shading.w_dx = shading.w_dy = 0.0f;
+        for (int i = 0; i < 3; ++i)
         {
-            a1 = a1_vec;
-            a2 = a2_vec;
-            a3 = a3_vec;
-
-            for (size_t w = minX; w <= maxX; w += hStepSize)
-            {
-                auto mask = SIMD::Vec4ss::generate_nmask(a1, a2, a3);
-                if (mask > 0)
-                {
-
-                    size_t offset = (platform.colorBuffer.height - 1 - h) * platform.colorBuffer.width *
-                                    platform.colorBuffer.noChannels;
-                    uint8_t *off   = platform.colorBuffer.buffer + offset + w * platform.colorBuffer.noChannels;
-                    uint8_t *mem   = off;
-                    auto     depth = &platform.zBuffer.buffer[h * platform.zBuffer.width + w];
-                    using namespace SIMD;
-                    auto   zero = _mm_setzero_ps();
-                    __m128 a    = _mm_unpackhi_ps(a2.vec, a1.vec);
-                    __m128 b    = _mm_unpackhi_ps(zero, a3.vec);
-                    __m128 c    = _mm_unpacklo_ps(a2.vec, a1.vec);
-                    __m128 d    = _mm_unpacklo_ps(zero, a3.vec);
-
-                    // Lol shuffle ni garna parxa tw
-                    auto lvec1 = Vec4ss(_mm_movehl_ps(a, b));
-                    auto lvec2 = Vec4ss(_mm_movelh_ps(b, a));
-
-                    auto lvec3 = Vec4ss(_mm_movehl_ps(c, d));
-                    auto lvec4 = Vec4ss(_mm_movelh_ps(d, c));
-
-                    lvec1      = Vec4ss(_mm_shuffle_ps(lvec1.vec, lvec1.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec2      = Vec4ss(_mm_shuffle_ps(lvec2.vec, lvec2.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec3      = Vec4ss(_mm_shuffle_ps(lvec3.vec, lvec3.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec4      = Vec4ss(_mm_shuffle_ps(lvec4.vec, lvec4.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    if (mask & 0x08)
-                    {
-                        // plot first pixel
-                        // calculate z
-
-                        float z        = lvec1.dot(zvec);
-                        lvec1          = lvec1 * inv_w;
-                        auto  bary_sum = lvec1.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
-
-                        float a[4];
-                        _mm_store_ps(a, lvec1.vec);
-                        if (z < depth[0])
-                        {
-                            auto rgb = (a[3] * v0.color + a[2] * v1.color + a[1] * v2.color) * (1.0f / bary_sum);
-                            // sample texture
-                            // flat shading
-                            // rgb      = rgb + (light.color - rgb) * shade;
-                            // phong shading
-
-                            // interpolate using barycentric co-ordinate, position of the vertices to find current
-                            // fragPos
-
-                            rgb = rgb + (light.color - rgb) * shade;
-                            if constexpr (shading == Shading::Phong)
-                            {
-                                auto pixelPos =
-                                    (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
-                                // specular constant
-                                // reflected vector
-                                auto reflect_vec = Vec3f(pixelPos - light.position).unit().reflect(normal).unit();
-                                auto specular = powf(vMax(0.0f, (cameraPos - pixelPos).unit().dot(reflect_vec)), shiny);
-
-                                rgb           = rgb + light.color * specular;
-                            }
-
-                            depth[0] = z;
-                            // mem[0]   = std::clamp(rgb.z * 255,0.0f,1.0f);
-                            // mem[1]   = rgb.y * 255;
-                            // mem[2]   = rgb.x * 255;
-                            // mem[3]   = rgb.w * 255;
-
-                            mem[0] = std::clamp(rgb.z, 0.0f, 1.0f) * 255;
-                            mem[1] = std::clamp(rgb.y, 0.0f, 1.0f) * 255;
-                            mem[2] = std::clamp(rgb.x, 0.0f, 1.0f) * 255;
-                            mem[3] = std::clamp(rgb.w, 0.0f, 1.0f) * 255;
-                        }
-                    }
-
-                    if (mask & 0x04)
-                    {
-                        // plot second pixel
-                        mem            = off + 4;
-
-                        float z        = lvec2.dot(zvec);
-                        lvec2          = lvec2 * inv_w;
-                        auto  bary_sum = lvec2.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
-
-                        float a[4];
-                        _mm_store_ps(a, lvec2.vec);
+            auto const &edge = d[(i + 1) % 3];
+            float       dx   = edge.y * v[i]->inv_w / area;
+            float       dy   = -edge.x * v[i]->inv_w / area;
+            shading.uv_dx    = shading.uv_dx + dx * v[i]->texCoord;
+            shading.uv_dy    = shading.uv_dy + dy * v[i]->texCoord;
+            shading.w_dx += dx;
+            shading.w_dy += dy;
+        }
+    }
+}
 
-                        if (z < depth[1])
-                        {
-                            // sample texture
-                            auto rgb = (a[3] * v0.color + a[2] * v1.color + a[1] * v2.color) * (1.0f / bary_sum);
-                            rgb      = rgb + (light.color - rgb) * shade;
+// log2 from the exponent and a linearly interpolated mantissa, off by 0.09 at most which is plenty to pick a mip level
+static float ApproxLog2(float x)
+{
+    auto bits = std::bit_cast<int32_t>(x);
+    return static_cast<float>((bits >> 23) - 127) + (std::bit_cast<float>((bits & 0x007FFFFF) | 0x3F800000) - 1.0f);
+}
 
-                            if constexpr (shading == Shading::Phong)
-                            {
+// Mip level for the fragment at uv, w_sum being the sum of its perspective weights
+// Derivatives of uv = sum(w_i * uv_i) / sum(w_i) follow from the quotient rule, lod is log2 of the longer of the
+// texel footprints along x and y
+static float TextureLod(TriangleShading const &shading, Vec2f uv, float w_sum)
+{
+    auto  size = Vec2f(static_cast<float>(shading.texture->width), static_cast<float>(shading.texture->height));
+    auto  dx   = (shading.uv_dx - shading.w_dx * uv) * (1.0f / w_sum);
+    auto  dy   = (shading.uv_dy - shading.w_dy * uv) * (1.0f / w_sum);
+    float lx   = dx.x * size.x * dx.x * size.x + dx.y * size.y * dx.y * size.y;
+    float ly   = dy.x * size.x * dy.x * size.x + dy.y * size.y * dy.y * size.y;
+    return 0.5f * ApproxLog2(vMax(lx, ly));
+}
 
-                                auto pixelPos =
-                                    (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
-                                auto reflect_vec = Vec3f(pixelPos - light.position).unit().reflect(normal).unit();
-                                auto specular = powf(vMax(0.0f, (cameraPos - pixelPos).unit().dot(reflect_vec)), shiny);
-                                rgb           = rgb + light.color * specular;
-                            }
-                            depth[1] = z;
-                            // mem[0]   = rgb.z * 255;
-                            // mem[1]   = rgb.y * 255;
-                            // mem[2]   = rgb.x * 255;
-                            // mem[3]   = rgb.w * 255;
-
-                            // mem[0]   = std::clamp(rgb.z * 255, 0.0f, 1.0f);
-                            // mem[1]   = std::clamp(rgb.y * 255, 0.0f, 1.0f);
-                            // mem[2]   = std::clamp(rgb.x * 255, 0.0f, 1.0f);
-                            // mem[3]   = std::clamp(rgb.w * 255, 0.0f, 1.0f);
-
-                            mem[0] = std::clamp(rgb.z, 0.0f, 1.0f) * 255;
-                            mem[1] = std::clamp(rgb.y, 0.0f, 1.0f) * 255;
-                            mem[2] = std::clamp(rgb.x, 0.0f, 1.0f) * 255;
-                            mem[3] = std::clamp(rgb.w, 0.0f, 1.0f) * 255;
-                        }
-                    }
-                    if (mask & 0x02)
-                    {
-                        // plot third pixel
-                        mem            = off + 8;
-                        float z        = lvec3.dot(zvec);
-                        lvec3          = lvec3 * inv_w;
-                        auto  bary_sum = lvec3.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+// Shades one pixel into mem
+// a holds the perspective correct barycentric weights of v0, v1 and v2 in lanes 3, 2 and 1, bary_sum their sum
+static void ShadeFragment(FrameUniforms const &uniforms, TriangleShading const &shading, float const *a, float bary_sum,
+                          Platform const &platform, uint8_t *mem)
+{
+    auto const &light = uniforms.light;
+    auto const     &v0    = shading.tri->v0;
+    auto const     &v1    = shading.tri->v1;
+    auto const     &v2    = shading.tri->v2;
 
-                        float a[4];
-                        _mm_store_ps(a, lvec3.vec);
+    if (shading.tri->merge_mode == RenderDevice::MergeMode::COLOR_MODE)
+    {
+        auto rgb = (a[3] * v0.color + a[2] * v1.color + a[1] * v2.color) * (1.0f / bary_sum);
+        // flat shading
+        // rgb      = rgb + (light.color - rgb) * shade;
+        // phong shading
 
-                        if (z < depth[2])
-                        {
-                            // sample texture
-                            auto rgb = (a[3] * v0.color + a[2] * v1.color + a[1] * v2.color) * (1.0f / bary_sum);
-                            rgb      = rgb + (light.color - rgb) * shade;
+        // interpolate using barycentric co-ordinate, position of the vertices to find current
+        // fragPos
 
-                            if constexpr (shading == Shading::Phong)
-                            {
+        rgb = rgb + (light.color - rgb) * shading.shade;
+        if constexpr (::shading == Shading::Phong)
+        {
+            auto pixelPos = (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
+            // specular constant
+            // reflected vector
+            auto reflect_vec = Vec3f(pixelPos - light.position).unit().reflect(shading.normal).unit();
+            auto specular =
+                powf(vMax(0.0f, (uniforms.cameraPos - pixelPos).unit().dot(reflect_vec)), float(uniforms.shininess));
+
+            rgb              = rgb + light.color * specular;
+        }
 
-                                auto pixelPos =
-                                    (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
-                                auto reflect_vec = Vec3f(pixelPos - light.position).unit().reflect(normal).unit();
-                                auto specular = powf(vMax(0.0f, (cameraPos - pixelPos).unit().dot(reflect_vec)), shiny);
+        mem[0] = std::clamp(rgb.z, 0.0f, 1.0f) * 255;
+        mem[1] = std::clamp(rgb.y, 0.0f, 1.0f) * 255;
+        mem[2] = std::clamp(rgb.x, 0.0f, 1.0f) * 255;
+        mem[3] = std::clamp(rgb.w, 0.0f, 1.0f) * 255;
+        return;
+    }
 
-                                rgb           = rgb + light.color * specular;
-                            }
-                            depth[2] = z;
-                            // mem[0]   = rgb.z * 255;
-                            // mem[1]   = rgb.y * 255;
-                            // mem[2]   = rgb.x * 255;
-                            // mem[3]   = 0x00;
-
-                            mem[0] = std::clamp(rgb.z, 0.0f, 1.0f) * 255;
-                            mem[1] = std::clamp(rgb.y, 0.0f, 1.0f) * 255;
-                            mem[2] = std::clamp(rgb.x, 0.0f, 1.0f) * 255;
-                            mem[3] = std::clamp(rgb.w, 0.0f, 1.0f) * 255;
-                        }
-                    }
-                    if (mask & 0x01)
-                    {
-                        // plot fourth pixel
-                        mem            = off + 12;
-                        float z        = lvec4.dot(zvec);
-                        lvec4          = lvec4 * inv_w;
-                        auto  bary_sum = lvec4.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+    // Retrieve the uv co-ordinate of texture using the barycentric co-ordinate
+    // Depth and uv could be calculated incrementally, but lets not work on that for now
+    auto uv  = (a[3] * v0.texCoord + a[2] * v1.texCoord + a[1] * v2.texCoord) * (1.0f / bary_sum);
+    auto rgb = shading.sampler.Sample(uv, TextureLod(shading, uv, bary_sum));
+    // Now sample from depth texture
+    // I think that shadow map should be converted first to texture, so that it would be easier
+    // to sample depth value directly from the texture But lets go without it for now Get the
+    // position of the current pixel
+
+    // auto pixelPos =
+    //  (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
+    // Transform it using the earlier defined ortho + view projection to find its position in
+    // shadow map Lmao .. really? Is depth mapping that much expensive? Need to do per pixel
+    // matrix multiplication? I guess, it would be fine to calculate this transformation once
+    // for each vertex and then do barycentric interpolation along the way
+
+    // For now, going with matrix transformation
+
+    // auto posInShadowMap = lightOrtho * lightView * pixelPos;
+    // Ready to burn CPU?
+    // This not enough, now need to sample the depth value at that position
+
+    // To do that :
+    // Basically, we drew shadow map from the perspective of light which maps the region into
+    // NDC co-ordinates, ignoring depth x and y are mapped to -1 and 1 which needs to be
+    // remapped into the range of 0 to 1 for easy sampling lets not do that remap, and continue
+    // with manual sampling
+
+    // So take this point and try to retrieve the depth information
+    // Where's emacs artist mode?
+
+    /*
+        -------------------------------------------------------------------------------
+        |                                                                       (w,h) |
+        |                                                                             |
+        |                               Vertically it ranges from -1 to +1            |
+        |                                   Its same horizontally                     |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |                                                                             |
+        |   Its inverted due to going with openGL style and how top down bitmap stored|
+        |(0,0)                                                                        |
+        -------------------------------------------------------------------------------
+
+
+    */
+    // So take the current obtained point in the range of [-1,1]x[-1,1] and remap to [0,1]
+    // First horizontal mapping
+    // do barycentric interpolation
+    auto posInShadowMap =
+        (a[3] * shading.shadowPos0 + a[2] * shading.shadowPos1 + a[1] * shading.shadowPos2) * (1.0f / bary_sum);
+
+    auto sampleX            = (posInShadowMap.x + 1) / 2.0f;
+    auto sampleY            = (posInShadowMap.y + 1) / 2.0f;
+    sampleX                 = std::clamp(sampleX, 0.0f, 1.0f);
+    sampleY                 = std::clamp(sampleY, 0.0f, 1.0f);
+    // Retrieve the sample at that position
+    uint32_t imgX           = sampleX * (platform.shadowMap.width - 1);
+    uint32_t imgY           = sampleY * (platform.shadowMap.height - 1);
+
+    float z_from_light_pers = platform.shadowMap.buffer[imgY * platform.shadowMap.width + imgX];
+    // If they are the same point seen directly both by light and the eye, they must have same
+    // depth value
+    auto current_z          = std::clamp(posInShadowMap.z, 0.0f, 1.0f);
+    // This calculation can be done incrementally, by calculating first at each vertex and then
+    // incrementally calculating other things
+    auto nshade             = shading.shade;
+    if (z_from_light_pers < current_z - uniforms.shadowBias)
+    {
+        // The current point must be in the shadow, so occlude it
+        // Preferably use shadow correction factor, but its ok
+        nshade = uniforms.shadowShade;
+    }
 
-                        float a[4];
-                        _mm_store_ps(a, lvec4.vec);
+    mem[0] = rgb.z * nshade;
+    mem[1] = rgb.y * nshade;
+    mem[2] = rgb.x * nshade;
+    mem[3] = 0x00;
+}
 
-                        if (z < depth[3])
-                        {
-                            // sample texture
-                            auto rgb = (a[3] * v0.color + a[2] * v1.color + a[1] * v2.color) * (1.0f / bary_sum);
-                            rgb      = rgb + (light.color - rgb) * shade;
+// Structure of arrays 3 component vector, one register per component
+struct Vec3x4
+{
+    __m128 x, y, z;
 
-                            if constexpr (shading == Shading::Phong)
-                            {
+    Vec3x4() = default;
+    Vec3x4(__m128 x, __m128 y, __m128 z) : x{x}, y{y}, z{z}
+    {
+    }
+    explicit Vec3x4(Vec3f const &v) : x{_mm_set1_ps(v.x)}, y{_mm_set1_ps(v.y)}, z{_mm_set1_ps(v.z)}
+    {
+    }
+    Vec3x4 operator-(Vec3x4 const &v) const
+    {
+        return {_mm_sub_ps(x, v.x), _mm_sub_ps(y, v.y), _mm_sub_ps(z, v.z)};
+    }
+    __m128 dot(Vec3x4 const &v) const
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, v.x), _mm_mul_ps(y, v.y)), _mm_mul_ps(z, v.z));
+    }
+    // Zero length vectors stay zero, as with Vec3f::unit
+    Vec3x4 unit() const
+    {
+        auto mag = _mm_sqrt_ps(dot(*this));
+        auto inv = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), mag), _mm_cmpneq_ps(mag, _mm_setzero_ps()));
+        return {_mm_mul_ps(x, inv), _mm_mul_ps(y, inv), _mm_mul_ps(z, inv)};
+    }
+};
 
-                                auto pixelPos =
-                                    (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
-                                auto reflect_vec = Vec3f(pixelPos - light.position).unit().reflect(normal).unit();
-                                auto specular = powf(vMax(0.0f, (cameraPos - pixelPos).unit().dot(reflect_vec)), shiny);
+// w0 * a + w1 * b + w2 * c, lane by lane
+static __m128 Interpolate(__m128 w0, __m128 w1, __m128 w2, __m128 a, __m128 b, __m128 c)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, a), _mm_mul_ps(w1, b)), _mm_mul_ps(w2, c));
+}
 
-                                rgb           = rgb + light.color * specular;
-                            }
-                            depth[3] = z;
-                            // mem[0]   = rgb.z * 255;
-                            // mem[1]   = rgb.y * 255;
-                            // mem[2]   = rgb.x * 255;
-                            // mem[3]   = 0x00;
-
-                            mem[0] = std::clamp(rgb.z, 0.0f, 1.0f) * 255;
-                            mem[1] = std::clamp(rgb.y, 0.0f, 1.0f) * 255;
-                            mem[2] = std::clamp(rgb.x, 0.0f, 1.0f) * 255;
-                            mem[3] = std::clamp(rgb.w, 0.0f, 1.0f) * 255;
-                        }
-                    }
-                }
+// Constants of the vectorised colour shader, splatted once per triangle
+struct ColorQuadShading
+{
+    __m128 inv_w[3];    // 1 / w of each vertex divided by the area
+    __m128 color[3][4]; // vertex colours, channel by channel
+    Vec3x4 frag_pos[3];
+    __m128 light_color[4];
+    Vec3x4 light_pos, camera_pos;
+    Vec3x4   normal; // unit
+    __m128   shade;
+    uint32_t shininess;
+};
+
+static void SetupColorQuadShading(FrameUniforms const &uniforms, TriangleShading const &shading, float area,
+                                  ColorQuadShading &quad)
+{
+    RasterInfo const *v[3] = {&shading.tri->v0, &shading.tri->v1, &shading.tri->v2};
+    for (int i = 0; i < 3; ++i)
+    {
+        quad.inv_w[i]    = _mm_set1_ps(v[i]->inv_w / area);
+        quad.color[i][0] = _mm_set1_ps(v[i]->color.x);
+        quad.color[i][1] = _mm_set1_ps(v[i]->color.y);
+        quad.color[i][2] = _mm_set1_ps(v[i]->color.z);
+        quad.color[i][3] = _mm_set1_ps(v[i]->color.w);
+        quad.frag_pos[i] = Vec3x4(Vec3f(v[i]->frag_pos));
+    }
+    quad.light_color[0] = _mm_set1_ps(uniforms.light.color.x);
+    quad.light_color[1] = _mm_set1_ps(uniforms.light.color.y);
+    quad.light_color[2] = _mm_set1_ps(uniforms.light.color.z);
+    quad.light_color[3] = _mm_set1_ps(uniforms.light.color.w);
+    quad.light_pos      = Vec3x4(Vec3f(uniforms.light.position));
+    quad.camera_pos     = Vec3x4(uniforms.cameraPos);
+    quad.normal         = Vec3x4(shading.normal.unit());
+    quad.shade          = _mm_set1_ps(shading.shade);
+    quad.shininess      = uniforms.shininess;
+}
 
-                a1 = a1 + inc_a1;
-                a2 = a2 + inc_a2;
-                a3 = a3 + inc_a3;
-            }
-            a1_vec = a1_vec + inc_a1_;
-            a2_vec = a2_vec + inc_a2_;
-            a3_vec = a3_vec + inc_a3_;
-        }
+// Writes the packed BGRA pixels of a group, only the lanes in mask. A group wholly inside the span is one blended store
+static void StoreQuad(__m128i packed, QuadFragments const &f, uint32_t mask, uint8_t *mem, int32_t channels)
+{
+    if (channels == 4 && f.inside == 0x0F)
+    {
+        auto old = _mm_loadu_si128(reinterpret_cast<__m128i *>(mem));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(mem),
+                         _mm_blendv_epi8(old, packed, _mm_castps_si128(LaneMask(mask))));
+        return;
     }
-    else
+    alignas(16) uint32_t pixels[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(pixels), packed);
+    for (; mask; mask &= mask - 1)
     {
-        // auto inv_w   = SIMD::Vec4ss(v0.inv_w / area, v1.inv_w / area, v2.inv_w / area, 0.0f);
-        // Do depth mapping for textured floor for now
-        auto texture = GetActiveTexture();
-        for (size_t h = minY; h <= maxY; ++h)
-        {
-            a1                   = a1_vec;
-            a2                   = a2_vec;
-            a3                   = a3_vec;
+        int32_t k = std::countr_zero(mask);
+        std::memcpy(mem + k * channels, &pixels[k], vMin(channels, 4));
+    }
+}
 
-            constexpr float bias = 0.005f;
-            for (size_t w = minX; w <= maxX; w += hStepSize)
-            {
-                auto mask = SIMD::Vec4ss::generate_nmask(a1, a2, a3);
-                if (mask > 0)
-                {
-                    size_t offset = (platform.colorBuffer.height - 1 - h) * platform.colorBuffer.width *
-                                    platform.colorBuffer.noChannels;
-                    uint8_t *off   = platform.colorBuffer.buffer + offset + w * platform.colorBuffer.noChannels;
-                    uint8_t *mem   = off;
-                    auto     depth = &platform.zBuffer.buffer[h * platform.zBuffer.width + w];
-                    using namespace SIMD;
-                    auto   zero = _mm_setzero_ps();
-                    __m128 a    = _mm_unpackhi_ps(a2.vec, a1.vec);
-                    __m128 b    = _mm_unpackhi_ps(zero, a3.vec);
-                    __m128 c    = _mm_unpacklo_ps(a2.vec, a1.vec);
-                    __m128 d    = _mm_unpacklo_ps(zero, a3.vec);
-
-                    // Lol shuffle ni garna parxa tw
-                    auto lvec1 = Vec4ss(_mm_movehl_ps(a, b));
-                    auto lvec2 = Vec4ss(_mm_movelh_ps(b, a));
-
-                    auto lvec3 = Vec4ss(_mm_movehl_ps(c, d));
-                    auto lvec4 = Vec4ss(_mm_movelh_ps(d, c));
-
-                    lvec1      = Vec4ss(_mm_shuffle_ps(lvec1.vec, lvec1.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec2      = Vec4ss(_mm_shuffle_ps(lvec2.vec, lvec2.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec3      = Vec4ss(_mm_shuffle_ps(lvec3.vec, lvec3.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                    lvec4      = Vec4ss(_mm_shuffle_ps(lvec4.vec, lvec4.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-
-                    // Retrieve the uv co-ordinate of texture using the barycentric co-ordinate
-                    // These branches and lookup aren't that expensive
-                    // mtx locking is expensive
-                    // Depth and uv could be calculated incrementally, but lets not work on that for now
-                    if (mask & 0x08)
-                    {
-                        // plot first pixel
-                        // calculate z
+// ShadeFragment's colour path for a group of 4 pixels, lane k being the pixel at mem + k * channels
+// Interpolation, lighting and the RGBA8 pack go through all lanes at once, only the lanes in mask are written
+static void ShadeColorQuad(ColorQuadShading const &c, QuadFragments const &f, uint32_t mask, uint8_t *mem,
+                           int32_t channels)
+{
+    auto   zero    = _mm_setzero_ps();
+    auto   one     = _mm_set1_ps(1.0f);
+    // Perspective correct barycentrics
+    auto   w0      = _mm_mul_ps(f.b0, c.inv_w[0]);
+    auto   w1      = _mm_mul_ps(f.b1, c.inv_w[1]);
+    auto   w2      = _mm_mul_ps(f.b2, c.inv_w[2]);
+    auto   inv_sum = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(w0, w1), w2));
+
+    __m128 rgb[4];
+    for (int ch = 0; ch < 4; ++ch)
+    {
+        auto color = _mm_mul_ps(Interpolate(w0, w1, w2, c.color[0][ch], c.color[1][ch], c.color[2][ch]), inv_sum);
+        rgb[ch]    = _mm_add_ps(color, _mm_mul_ps(_mm_sub_ps(c.light_color[ch], color), c.shade));
+    }
 
-                        float z        = lvec1.dot(zvec);
-                        lvec1          = lvec1 * inv_w;
-                        auto  bary_sum = lvec1.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+    if constexpr (::shading == Shading::Phong)
+    {
+        auto const &p = c.frag_pos;
+        Vec3x4      pixelPos(_mm_mul_ps(Interpolate(w0, w1, w2, p[0].x, p[1].x, p[2].x), inv_sum),
+                             _mm_mul_ps(Interpolate(w0, w1, w2, p[0].y, p[1].y, p[2].y), inv_sum),
+                             _mm_mul_ps(Interpolate(w0, w1, w2, p[0].z, p[1].z, p[2].z), inv_sum));
+        auto        incident = (pixelPos - c.light_pos).unit();
+        auto        twice    = _mm_mul_ps(_mm_set1_ps(2.0f), incident.dot(c.normal));
+        auto        reflect_vec = Vec3x4(_mm_sub_ps(incident.x, _mm_mul_ps(twice, c.normal.x)),
+                                         _mm_sub_ps(incident.y, _mm_mul_ps(twice, c.normal.y)),
+                                         _mm_sub_ps(incident.z, _mm_mul_ps(twice, c.normal.z)))
+                               .unit();
+        auto        base     = _mm_max_ps(zero, (c.camera_pos - pixelPos).unit().dot(reflect_vec));
+        // Integer power by squaring
+        auto        specular = one;
+        for (uint32_t e = c.shininess; e; e >>= 1)
+        {
+            if (e & 1)
+                specular = _mm_mul_ps(specular, base);
+            base = _mm_mul_ps(base, base);
+        }
+        for (int ch = 0; ch < 4; ++ch)
+            rgb[ch] = _mm_add_ps(rgb[ch], _mm_mul_ps(c.light_color[ch], specular));
+    }
 
-                        float a[4];
-                        _mm_store_ps(a, lvec1.vec);
-                        auto uv = (a[3] * v0.texCoord + a[2] * v1.texCoord + a[1] * v2.texCoord) * (1.0f / bary_sum);
-                        if (z < depth[0])
-                        {
-                            // sample texture
-                            auto rgb = texture.Sample(uv);
-                            // Now sample from depth texture
-                            // I think that shadow map should be converted first to texture, so that it would be easier
-                            // to sample depth value directly from the texture But lets go without it for now Get the
-                            // position of the current pixel
-
-                            // auto pixelPos =
-                            //  (a[3] * v0.frag_pos + a[2] * v1.frag_pos + a[1] * v2.frag_pos) * (1.0f / bary_sum);
-                            // Transform it using the earlier defined ortho + view projection to find its position in
-                            // shadow map Lmao .. really? Is depth mapping that much expensive? Need to do per pixel
-                            // matrix multiplication? I guess, it would be fine to calculate this transformation once
-                            // for each vertex and then do barycentric interpolation along the way
-
-                            // For now, going with matrix transformation
-
-                            // auto posInShadowMap = lightOrtho * lightView * pixelPos;
-                            // Ready to burn CPU?
-                            // This not enough, now need to sample the depth value at that position
-
-                            // To do that :
-                            // Basically, we drew shadow map from the perspective of light which maps the region into
-                            // NDC co-ordinates, ignoring depth x and y are mapped to -1 and 1 which needs to be
-                            // remapped into the range of 0 to 1 for easy sampling lets not do that remap, and continue
-                            // with manual sampling
-
-                            // So take this point and try to retrieve the depth information
-                            // Where's emacs artist mode?
-
-                            /*
-                                -------------------------------------------------------------------------------
-                                |                                                                       (w,h) |
-                                |                                                                             |
-                                |                               Vertically it ranges from -1 to +1            |
-                                |                                   Its same horizontally                     |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |                                                                             |
-                                |   Its inverted due to going with openGL style and how top down bitmap stored|
-                                |(0,0)                                                                        |
-                                -------------------------------------------------------------------------------
-
-
-                            */
-                            // So take the current obtained point in the range of [-1,1]x[-1,1] and remap to [0,1]
-                            // First horizontal mapping
-                            // do barycentric interpolation
-                            auto posInShadowMap =
-                                (a[3] * shadowPos0 + a[2] * shadowPos1 + a[1] * shadowPos2) * (1.0f / bary_sum);
-
-                            auto sampleX = (posInShadowMap.x + 1) / 2.0f;
-                            auto sampleY = (posInShadowMap.y + 1) / 2.0f;
-                            sampleX      = std::clamp(sampleX, 0.0f, 1.0f);
-                            sampleY      = std::clamp(sampleY, 0.0f, 1.0f);
-                            // Retrieve the sample at that position
-                            uint32_t imgX           = sampleX * (platform.shadowMap.width - 1);
-                            uint32_t imgY           = sampleY * (platform.shadowMap.height - 1);
-
-                            float z_from_light_pers = platform.shadowMap.buffer[imgY * platform.shadowMap.width + imgX];
-                            // If they are the same point seen directly both by light and the eye, they must have same
-                            // depth value
-                            depth[0]       = z;
-                            auto current_z = std::clamp(posInShadowMap.z, 0.0f, 1.0f);
-                            // This calculation can be done incrementally, by calculating first at each vertex and then
-                            // incrementally calculating other things
-                            auto nshade = shade;
-                            if (z_from_light_pers < current_z - bias)
-                            {
-                                // The current point must be in the shadow, so occlude it
-                                // Preferably use shadow correction factor, but its ok
-                                nshade = 0.2f;
-                            }
+    // BGRA in memory
+    auto to_byte = [&](__m128 v) {
+        return _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), one), _mm_set1_ps(255.0f)));
+    };
+    auto packed = _mm_or_si128(_mm_or_si128(to_byte(rgb[2]), _mm_slli_epi32(to_byte(rgb[1]), 8)),
+                               _mm_or_si128(_mm_slli_epi32(to_byte(rgb[0]), 16), _mm_slli_epi32(to_byte(rgb[3]), 24)));
+    StoreQuad(packed, f, mask, mem, channels);
+}
 
-                            mem[0] = rgb.z * nshade;
-                            mem[1] = rgb.y * nshade;
-                            mem[2] = rgb.x * nshade;
-                            mem[3] = 0x00;
-                        }
-                    }
+// Constants of the vectorised texture coordinates, mip selection and shadow test, splatted once per triangle
+struct TexturedQuadShading
+{
+    __m128       inv_w[3]; // 1 / w of each vertex divided by the area
+    __m128       u[3], v[3];
+    __m128       uv_dx[2], uv_dy[2], w_dx, w_dy; // see TriangleShading
+    __m128       size[2];                        // of the texture, in texels
+    Vec3x4       shadow_pos[3];                  // of each vertex, in the light's clip space
+    __m128       shade, shadow_shade, shadow_bias;
+    __m128       shadow_last[2]; // last texel of the shadow map along x and y
+    float const *shadow_map;
+    __m128i      shadow_width;
+};
+
+static void SetupTexturedQuadShading(FrameUniforms const &uniforms, TriangleShading const &shading, float area,
+                                     Platform const &platform, TexturedQuadShading &quad)
+{
+    RasterInfo const *v[3]      = {&shading.tri->v0, &shading.tri->v1, &shading.tri->v2};
+    Vec4f const      *shadow[3] = {&shading.shadowPos0, &shading.shadowPos1, &shading.shadowPos2};
+    for (int i = 0; i < 3; ++i)
+    {
+        quad.inv_w[i]      = _mm_set1_ps(v[i]->inv_w / area);
+        quad.u[i]          = _mm_set1_ps(v[i]->texCoord.x);
+        quad.v[i]          = _mm_set1_ps(v[i]->texCoord.y);
+        quad.shadow_pos[i] = Vec3x4(Vec3f(*shadow[i]));
+    }
+    auto const &sm       = platform.shadowMap;
+    quad.shade           = _mm_set1_ps(shading.shade);
+    quad.shadow_shade    = _mm_set1_ps(uniforms.shadowShade);
+    quad.shadow_bias     = _mm_set1_ps(uniforms.shadowBias);
+    quad.shadow_last[0]  = _mm_set1_ps(static_cast<float>(sm.width - 1));
+    quad.shadow_last[1]  = _mm_set1_ps(static_cast<float>(sm.height - 1));
+    quad.shadow_map      = sm.buffer;
+    quad.shadow_width    = _mm_set1_epi32(static_cast<int32_t>(sm.width));
+    quad.uv_dx[0] = _mm_set1_ps(shading.uv_dx.x);
+    quad.uv_dx[1] = _mm_set1_ps(shading.uv_dx.y);
+    quad.uv_dy[0] = _mm_set1_ps(shading.uv_dy.x);
+    quad.uv_dy[1] = _mm_set1_ps(shading.uv_dy.y);
+    quad.w_dx     = _mm_set1_ps(shading.w_dx);
+    quad.w_dy     = _mm_set1_ps(shading.w_dy);
+    quad.size[0]  = _mm_set1_ps(static_cast<float>(shading.texture->width));
+    quad.size[1]  = _mm_set1_ps(static_cast<float>(shading.texture->height));
+}
 
-                    if (mask & 0x04)
-                    {
-                        // plot second pixel
-                        mem            = off + 4;
+// ApproxLog2 lane by lane
+static __m128 ApproxLog2(__m128 x)
+{
+    auto bits     = _mm_castps_si128(x);
+    auto exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    auto mantissa = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000));
+    return _mm_add_ps(exponent, _mm_sub_ps(_mm_castsi128_ps(mantissa), _mm_set1_ps(1.0f)));
+}
 
-                        float z        = lvec2.dot(zvec);
-                        lvec2          = lvec2 * inv_w;
-                        auto  bary_sum = lvec2.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+// Filtered texels of a group of 4 pixels, with TextureLod done for all lanes at once
+// w receives the perspective correct weights of v0, v1 and v2
+static void SampleTexturedQuad(TexturedQuadShading const &c, TextureSampler const &sampler, QuadFragments const &f,
+                               __m128 w[3], __m128 rgb[3])
+{
+    w[0]         = _mm_mul_ps(f.b0, c.inv_w[0]);
+    w[1]         = _mm_mul_ps(f.b1, c.inv_w[1]);
+    w[2]         = _mm_mul_ps(f.b2, c.inv_w[2]);
+    auto inv_sum = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(w[0], w[1]), w[2]));
+    auto u       = _mm_mul_ps(Interpolate(w[0], w[1], w[2], c.u[0], c.u[1], c.u[2]), inv_sum);
+    auto v       = _mm_mul_ps(Interpolate(w[0], w[1], w[2], c.v[0], c.v[1], c.v[2]), inv_sum);
+
+    // Squared length of the texel footprint along one screen axis
+    auto footprint = [&](__m128 const *uv_d, __m128 w_d) {
+        auto du = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(uv_d[0], _mm_mul_ps(w_d, u)), inv_sum), c.size[0]);
+        auto dv = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(uv_d[1], _mm_mul_ps(w_d, v)), inv_sum), c.size[1]);
+        return _mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv));
+    };
+    auto lod = _mm_mul_ps(_mm_set1_ps(0.5f), ApproxLog2(_mm_max_ps(footprint(c.uv_dx, c.w_dx),
+                                                                    footprint(c.uv_dy, c.w_dy))));
+    sampler.Sample4(u, v, lod, rgb);
+}
 
-                        float a[4];
-                        _mm_store_ps(a, lvec2.vec);
+// ShadeFragment's texture path for a group of 4 pixels, w and rgb being what SampleTexturedQuad gave for it
+// Shadow map lookup, depth test, shade and the RGBA8 pack go through all lanes at once, only the lanes in mask are
+// written
+static void ShadeTexturedQuad(TexturedQuadShading const &c, __m128 const w[3], __m128 const rgb[3],
+                              QuadFragments const &f, uint32_t mask, uint8_t *mem, int32_t channels)
+{
+    auto        zero    = _mm_setzero_ps();
+    auto        one     = _mm_set1_ps(1.0f);
+    auto        inv_sum = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(w[0], w[1]), w[2]));
+    auto const &p       = c.shadow_pos;
+    auto        x       = _mm_mul_ps(Interpolate(w[0], w[1], w[2], p[0].x, p[1].x, p[2].x), inv_sum);
+    auto        y       = _mm_mul_ps(Interpolate(w[0], w[1], w[2], p[0].y, p[1].y, p[2].y), inv_sum);
+    auto        z       = _mm_mul_ps(Interpolate(w[0], w[1], w[2], p[0].z, p[1].z, p[2].z), inv_sum);
+
+    // [-1, 1] to texels of the shadow map. NaNs of the lanes outside the triangle clamp to 0, every lookup stays in
+    // the map
+    auto clamp01 = [&](__m128 v) { return _mm_min_ps(_mm_max_ps(v, zero), one); };
+    auto half    = _mm_set1_ps(0.5f);
+    auto img_x   = _mm_cvttps_epi32(_mm_mul_ps(clamp01(_mm_mul_ps(_mm_add_ps(x, one), half)), c.shadow_last[0]));
+    auto img_y   = _mm_cvttps_epi32(_mm_mul_ps(clamp01(_mm_mul_ps(_mm_add_ps(y, one), half)), c.shadow_last[1]));
+    alignas(16) int32_t texel[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(texel), _mm_add_epi32(_mm_mullo_epi32(img_y, c.shadow_width), img_x));
+    auto depth    = _mm_setr_ps(c.shadow_map[texel[0]], c.shadow_map[texel[1]], c.shadow_map[texel[2]],
+                                c.shadow_map[texel[3]]);
+    auto shadowed = _mm_cmplt_ps(depth, _mm_sub_ps(clamp01(z), c.shadow_bias));
+    auto shade    = _mm_blendv_ps(c.shade, c.shadow_shade, shadowed);
+
+    // BGR in memory, alpha left at 0
+    auto to_byte = [&](__m128 v) {
+        return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(v, shade), zero), _mm_set1_ps(255.0f)));
+    };
+    auto packed = _mm_or_si128(_mm_or_si128(to_byte(rgb[2]), _mm_slli_epi32(to_byte(rgb[1]), 8)),
+                               _mm_slli_epi32(to_byte(rgb[0]), 16));
+    StoreQuad(packed, f, mask, mem, channels);
+}
 
-                        auto uv = (a[3] * v0.texCoord + a[2] * v1.texCoord + a[1] * v2.texCoord) * (1.0f / bary_sum);
-                        if (z < depth[1])
-                        {
-                            // sample texture
-                            auto rgb = texture.Sample(uv);
-                            auto posInShadowMap =
-                                (a[3] * shadowPos0 + a[2] * shadowPos1 + a[1] * shadowPos2) * (1.0f / bary_sum);
-
-                            auto sampleX            = (posInShadowMap.x + 1) / 2.0f;
-                            auto sampleY            = (posInShadowMap.y + 1) / 2.0f;
-                            sampleX                 = std::clamp(sampleX, 0.0f, 1.0f);
-                            sampleY                 = std::clamp(sampleY, 0.0f, 1.0f);
-                            uint32_t imgX           = sampleX * (platform.shadowMap.width - 1);
-                            uint32_t imgY           = sampleY * (platform.shadowMap.height - 1);
-
-                            float z_from_light_pers = platform.shadowMap.buffer[imgY * platform.shadowMap.width + imgX];
-                            // If they are the same point seen directly both by light and the eye, they must have same
-                            // depth value
-                            auto current_z = std::clamp(posInShadowMap.z, 0.0f, 1.0f);
-
-                            depth[1]       = z;
-                            auto nshade    = shade;
-                            if (z_from_light_pers < current_z - bias)
-                            {
-                                nshade = 0.2f;
-                            }
-                            mem[0] = rgb.z * nshade;
-                            mem[1] = rgb.y * nshade;
-                            mem[2] = rgb.x * nshade;
-                            mem[3] = 0x00;
-                        }
-                    }
-                    if (mask & 0x02)
-                    {
-                        // plot third pixel
-                        mem            = off + 8;
-                        float z        = lvec3.dot(zvec);
-                        lvec3          = lvec3 * inv_w;
-                        auto  bary_sum = lvec3.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+// Rasterises the part of tri inside the bounds
+// Forward mode (visibility == nullptr) shades every fragment that passes the depth test. Deferred mode only records
+// triangle_id and the barycentrics of the fragment in the visibility buffer, shading is left to the resolve pass
+static void Rasteriser(BinnedTriangle const &tri, int32_t XMinBound, int32_t XMaxBound, int32_t YMinBound,
+                       int32_t YMaxBound, FrameUniforms const &uniforms, TileDepth &tile_depth,
+                       VisibilitySample *visibility, uint32_t triangle_id, PipelineStatistics &stats)
+{
+    auto const &v0       = tri.v0;
+    auto const &v1       = tri.v1;
+    auto const &v2       = tri.v2;
+    // Yup .. Now ready for flat shading
+    // the depth map somehow here
+    // Next smooth shading
+    Platform    platform = GetCurrentPlatform();
 
-                        float a[4];
-                        _mm_store_ps(a, lvec3.vec);
+    TriangleEdges edges;
+    if (!SetupEdges(v0, v1, v2, XMinBound, XMaxBound, YMinBound, YMaxBound, edges))
+        return;
+    float       area   = edges.area;
+    float       zmin   = vMin(v0.z, v1.z, v2.z);
 
-                        auto uv = (a[3] * v0.texCoord + a[2] * v1.texCoord + a[1] * v2.texCoord) * (1.0f / bary_sum);
-                        if (z < depth[2])
-                        {
-                            // sample texture
-                            auto rgb = texture.Sample(uv);
-                            auto posInShadowMap =
-                                (a[3] * shadowPos0 + a[2] * shadowPos1 + a[1] * shadowPos2) * (1.0f / bary_sum);
-
-                            auto sampleX = (posInShadowMap.x + 1) / 2.0f;
-                            auto sampleY = (posInShadowMap.y + 1) / 2.0f;
-                            sampleX      = std::clamp(sampleX, 0.0f, 1.0f);
-                            sampleY      = std::clamp(sampleY, 0.0f, 1.0f);
-                            // Retrieve the sample at that position
-                            uint32_t imgX           = sampleX * (platform.shadowMap.width - 1);
-                            uint32_t imgY           = sampleY * (platform.shadowMap.height - 1);
-
-                            float z_from_light_pers = platform.shadowMap.buffer[imgY * platform.shadowMap.width + imgX];
-                            // If they are the same point seen directly both by light and the eye, they must have same
-                            // depth value
-                            auto current_z = std::clamp(posInShadowMap.z, 0.0f, 1.0f);
-
-                            depth[2]       = z;
-                            auto nshade    = shade;
-                            if (z_from_light_pers < current_z - bias)
-                                nshade = 0.2f;
-                            mem[0] = rgb.z * nshade;
-                            mem[1] = rgb.y * nshade;
-                            mem[2] = rgb.x * nshade;
-                            mem[3] = 0x00;
-                        }
-                    }
-                    if (mask & 0x01)
-                    {
-                        // plot fourth pixel
-                        mem            = off + 12;
-                        float z        = lvec4.dot(zvec);
-                        lvec4          = lvec4 * inv_w;
-                        auto  bary_sum = lvec4.dot(Vec4ss(1.0f, 1.0f, 1.0f, 0.0f));
+    Vec3f       zplane = Vec3f(v0.z, v1.z, v2.z) * (1.0f / area);
+    auto       &zb     = platform.zBuffer;
+    auto const &cb     = platform.colorBuffer;
+    auto        pixel  = [&](int32_t w, int32_t h) {
+        return cb.buffer + ((cb.height - 1 - h) * cb.width + w) * cb.noChannels;
+    };
 
-                        float a[4];
-                        _mm_store_ps(a, lvec4.vec);
+    if (visibility)
+    {
+        auto inv_area = _mm_set1_ps(1.0f / area);
+        ForEachCoveredQuad(edges, zplane, zb.buffer, zb.width, &tile_depth, zmin, &stats,
+                           [&](int32_t x, int32_t h, uint32_t mask, QuadFragments const &f) {
+            alignas(16) float b1[4], b2[4];
+            _mm_store_ps(b1, _mm_mul_ps(f.b1, inv_area));
+            _mm_store_ps(b2, _mm_mul_ps(f.b2, inv_area));
+            for (; mask; mask &= mask - 1)
+            {
+                int32_t k                        = std::countr_zero(mask);
+                visibility[h * zb.width + x + k] = VisibilitySample{triangle_id, b1[k], b2[k]};
+            }
+        });
+        return;
+    }
 
-                        auto uv = (a[3] * v0.texCoord + a[2] * v1.texCoord + a[1] * v2.texCoord) * (1.0f / bary_sum);
-                        if (z < depth[3])
-                        {
-                            auto rgb = texture.Sample(uv);
-                            auto posInShadowMap =
-                                (a[3] * shadowPos0 + a[2] * shadowPos1 + a[1] * shadowPos2) * (1.0f / bary_sum);
-
-                            auto sampleX = (posInShadowMap.x + 1) / 2.0f;
-                            auto sampleY = (posInShadowMap.y + 1) / 2.0f;
-                            sampleX      = std::clamp(sampleX, 0.0f, 1.0f);
-                            sampleY      = std::clamp(sampleY, 0.0f, 1.0f);
-                            // Retrieve the sample at that position
-                            uint32_t imgX           = sampleX * (platform.shadowMap.width - 1);
-                            uint32_t imgY           = sampleY * (platform.shadowMap.height - 1);
-
-                            float z_from_light_pers = platform.shadowMap.buffer[imgY * platform.shadowMap.width + imgX];
-                            // If they are the same point seen directly both by light and the eye, they must have same
-                            // depth value
-                            auto current_z = std::clamp(posInShadowMap.z, 0.0f, 1.0f);
-
-                            depth[3]       = z;
-                            auto nshade    = shade;
-                            if (z_from_light_pers < current_z - bias)
-                                nshade = 0.2f;
-                            mem[0] = rgb.z * nshade;
-                            mem[1] = rgb.y * nshade;
-                            mem[2] = rgb.x * nshade;
-                            mem[3] = 0x00;
-                        }
-                    }
-                }
+    TriangleShading shading;
+    SetupShading(uniforms, tri, shading);
 
-                a1 = a1 + inc_a1;
-                a2 = a2 + inc_a2;
-                a3 = a3 + inc_a3;
-            }
-            a1_vec = a1_vec + inc_a1_;
-            a2_vec = a2_vec + inc_a2_;
-            a3_vec = a3_vec + inc_a3_;
-        }
+    if (tri.merge_mode == RenderDevice::MergeMode::COLOR_MODE)
+    {
+        ColorQuadShading constants;
+        SetupColorQuadShading(uniforms, shading, area, constants);
+        ForEachCoveredQuad(edges, zplane, zb.buffer, zb.width, &tile_depth, zmin, &stats,
+                           [&](int32_t x, int32_t h, uint32_t mask, QuadFragments const &f) {
+            stats.fragments_shaded += std::popcount(mask);
+            ShadeColorQuad(constants, f, mask, pixel(x, h), cb.noChannels);
+        });
+        return;
     }
+
+    TexturedQuadShading constants;
+    SetupTexturedQuadShading(uniforms, shading, area, platform, constants);
+    ForEachCoveredQuad(edges, zplane, zb.buffer, zb.width, &tile_depth, zmin, &stats,
+                       [&](int32_t x, int32_t h, uint32_t mask, QuadFragments const &f) {
+        __m128 w[3], texels[3];
+        stats.fragments_shaded += std::popcount(mask);
+        SampleTexturedQuad(constants, shading.sampler, f, w, texels);
+        ShadeTexturedQuad(constants, w, texels, f, mask, pixel(x, h), cb.noChannels);
+    });
 }
 
-static void ScreenSpace(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2, int32_t XMinBound,
-                        int32_t XMaxBound)
+static void ScreenSpace(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2,
+                        TriangleBins &bins, PipelineStatistics &stats)
 {
     Platform platform = GetCurrentPlatform();
     int      width_h  = (platform.width - 1) / 2;
     int      height_h = (platform.height - 1) / 2;
-    int      x0       = static_cast<int>(width_h * (v0.Position.x + 1));
-    int      x1       = static_cast<int>(width_h * (v1.Position.x + 1));
-    int      x2       = static_cast<int>(width_h * (v2.Position.x + 1));
+    int      x0       = SnapToSubpixel(width_h * (v0.Position.x + 1));
+    int      x1       = SnapToSubpixel(width_h * (v1.Position.x + 1));
+    int      x2       = SnapToSubpixel(width_h * (v2.Position.x + 1));
 
-    int      y0       = static_cast<int>(height_h * (1 + v0.Position.y));
-    int      y1       = static_cast<int>(height_h * (1 + v1.Position.y));
-    int      y2       = static_cast<int>(height_h * (1 + v2.Position.y));
+    int      y0       = SnapToSubpixel(height_h * (1 + v0.Position.y));
+    int      y1       = SnapToSubpixel(height_h * (1 + v1.Position.y));
+    int      y2       = SnapToSubpixel(height_h * (1 + v2.Position.y));
 
     float    z0       = v0.Position.z;
     float    z1       = v1.Position.z;
     float    z2       = v2.Position.z;
 
+    // Rasteriser only covers pixels for negative area (after the y flip), so anything else would only burn blocks
+    int64_t area = int64_t(x2 - x1) * (y1 - y0) - int64_t(x1 - x0) * (y2 - y1);
+    if (area == 0)
+    {
+        stats.triangles_zero_area++;
+        return;
+    }
+    if (area > 0)
+    {
+        stats.triangles_backface_culled++;
+        return;
+    }
+
     // With raster info struct now
     RasterInfo rs0(x0, y0, z0, v0.Position.w, v0.TexCoord, v0.Color, v0.FragPos);
     RasterInfo rs1(x1, y1, z1, v1.Position.w, v1.TexCoord, v1.Color, v1.FragPos);
@@ -639,226 +853,327 @@ static void ScreenSpace(VertexAttrib3D const &v0, VertexAttrib3D const &v1, Vert
     //// Use the parallel renderer to render all sections in parallel using above thread_pool
     // renderer.parallel_rasterize(thread_pool, rs0, rs1, rs2);
     //  wait until all worker thread have been completed
-    Parallel::Rasteriser(rs0, rs1, rs2, XMinBound, XMaxBound);
+    // Rasterisation is deferred to the tile pass
+    bins.bin(rs0, rs1, rs2);
 }
 
-static void ClipSpace2D(VertexAttrib3D v0, VertexAttrib3D v1, VertexAttrib3D v2, MemAlloc<VertexAttrib3D> &allocator,
-                        int32_t XMinBound, int32_t XMaxBound)
+// Clip space planes, a vertex is inside a plane when its ClipDistance to it is >= 0
+enum ClipPlane : uint32_t
 {
-    // The position data should be interpolated and passed before the perspective division phase
-
-    v0.Position = v0.Position.PerspectiveDivide();
-    v1.Position = v1.Position.PerspectiveDivide();
-    v2.Position = v2.Position.PerspectiveDivide();
-
-    std::vector<VertexAttrib3D, MemAlloc<VertexAttrib3D>> outVertices({v0, v1, v2}, allocator);
-    auto                                                  inVertices = outVertices;
-
-    std::vector<Vec2f, MemAlloc<Vec2f>>                   clipPoly(
-                          {Vec2(-1.0f, 1.0f), Vec2(-1.0f, -1.0f), Vec2(1.0f, -1.0f), Vec2(1.0f, 1.0f)}, allocator);
-
-    std::vector<Vec2f, MemAlloc<Vec2f>> clipLines(clipPoly.size(), allocator);
+    CLIP_NEAR   = 1 << 0, // z >= 0
+    CLIP_FAR    = 1 << 1, // z <= w
+    CLIP_LEFT   = 1 << 2, // x >= -w
+    CLIP_RIGHT  = 1 << 3, // x <= w
+    CLIP_BOTTOM = 1 << 4, // y >= -w
+    CLIP_TOP    = 1 << 5, // y <= w
+    CLIP_SIDES  = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP
+};
+
+static float ClipDistance(uint32_t plane, Vec4f const &p)
+{
+    switch (plane)
+    {
+    case CLIP_NEAR:
+        return p.z;
+    case CLIP_FAR:
+        return p.w - p.z;
+    case CLIP_LEFT:
+        return p.w + p.x;
+    case CLIP_RIGHT:
+        return p.w - p.x;
+    case CLIP_BOTTOM:
+        return p.w + p.y;
+    case CLIP_TOP:
+        return p.w - p.y;
+    }
+    return 0.0f;
+}
 
-    for (int i = 0; i < clipPoly.size(); ++i)
-        clipLines.at(i) = clipPoly.at((i + 1) % clipPoly.size()) - clipPoly.at(i);
+// Attributes are still linear in clip space, so plain interpolation is perspective correct here
+static VertexAttrib3D Lerp(VertexAttrib3D const &a, VertexAttrib3D const &b, float t)
+{
+    VertexAttrib3D v;
+    v.Position = a.Position + t * (b.Position - a.Position);
+    v.TexCoord = a.TexCoord + t * (b.TexCoord - a.TexCoord);
+    v.Color    = a.Color + t * (b.Color - a.Color);
+    v.FragPos  = a.FragPos + t * (b.FragPos - a.FragPos);
+    return v;
+}
 
-    size_t vert = 0;
-    outVertices.clear();
-    outVertices = {v0, v1, v2};
+// Convex polygon in clip space, clipped one plane at a time (Sutherland-Hodgman) in homogeneous coordinates
+// Every plane adds at most one vertex to a convex polygon, a triangle clipped by all six planes fits in 9
+// Lives on the stack of the setup loop, nothing is allocated per triangle
+struct ClipPolygon
+{
+    constexpr static int32_t capacity = 9;
+    VertexAttrib3D           vertices[capacity];
+    int32_t                  count = 0;
 
-    vert        = 0;
-    for (const auto &line : clipLines)
+    void                     clip(uint32_t planes)
     {
-        if (outVertices.size() == 1)
-            break;
-        inVertices = outVertices;
-        // If single point remained, discard it
-        outVertices.clear();
-
-        for (size_t i = 0; i < inVertices.size(); ++i)
+        ClipPolygon  scratch;
+        ClipPolygon *in  = this;
+        ClipPolygon *out = &scratch;
+        for (uint32_t plane = CLIP_NEAR; plane <= CLIP_TOP; plane <<= 1)
         {
-            auto const &v0 = inVertices.at(i), v1 = inVertices.at((i + 1) % inVertices.size());
-
-            auto head = Vec2<float>::Determinant(line, Vec2f(v1.Position.x, v1.Position.y) - clipPoly[vert]) >= 0;
-            auto tail = Vec2<float>::Determinant(line, Vec2f(v0.Position.x, v0.Position.y) - clipPoly[vert]) >= 0;
-
-            if (head && tail)
-                outVertices.push_back(v1);
-            else if (!(head || tail))
+            if (!(planes & plane) || in->count < 3)
                 continue;
-            else
+            out->count = 0;
+            for (int32_t i = 0; i < in->count; ++i)
             {
-                // This edge is divided by the clip line
-                auto intersection =
-                    LineIntersect(clipPoly[vert], clipPoly[vert] + line, Vec2f(v0.Position.x, v0.Position.y),
-                                  Vec2f(v1.Position.x, v1.Position.y));
-                auto point1 = clipPoly[vert] + line * intersection.x;
-                auto point2 =
-                    Vec2f(v0.Position.x, v0.Position.y) +
-                    (Vec2f(v1.Position.x, v1.Position.y) - Vec2f(v0.Position.x, v0.Position.y)) * intersection.y;
-
-                // point1 and point2 are same and are the intersection obtained by clipping against the clipping
-                // Poly Since they lie on the edge of the triangle, vertex attributes can be linearly
-                // interpolated across those two vertices
-                VertexAttrib3D inter;
-                inter.Position = Vec4f(point1, 0.0f, 1.0f); // <-- Todo
-
-                if (fabs(v1.Position.x - v0.Position.x) > fabs(v1.Position.y - v0.Position.y))
-                {
-                    // Use alternative interpolating scheme here
-                    float t = (inter.Position.x - v0.Position.x) / (v1.Position.x - v0.Position.x);
-                    // Interpolate depth, color_attributes and texture co-ordinates here
-                    // Interplate z/w linearly too
-                    inter.Position.w = v0.Position.w + t * (v1.Position.w - v0.Position.w);
+                auto const &a  = in->vertices[i];
+                auto const &b  = in->vertices[(i + 1) % in->count];
+                float       da = ClipDistance(plane, a.Position);
+                float       db = ClipDistance(plane, b.Position);
+                // Rounding could make the polygon a hair concave, never write past the end because of it
+                if (da >= 0.0f && out->count < capacity)
+                    out->vertices[out->count++] = a;
+                // Cut from the inside vertex, so an edge shared by two triangles is cut at the same point
+                if ((da >= 0.0f) != (db >= 0.0f) && out->count < capacity)
+                    out->vertices[out->count++] = da >= 0.0f ? Lerp(a, b, da / (da - db)) : Lerp(b, a, db / (db - da));
+            }
+            std::swap(in, out);
+        }
+        if (in != this)
+            *this = *in;
+    }
+};
 
-                    // Depth linearly, color_attributes and texture co-ordinates to be interpolated non-linearly
-                    inter.Position.z  = v0.Position.z + t * (v1.Position.z - v0.Position.z);
+// Screen space position of a perspective divided vertex is inside the guard band
+static bool InsideGuardBand(Platform const &platform, Vec4f const &position)
+{
+    int width_h  = (platform.width - 1) / 2;
+    int height_h = (platform.height - 1) / 2;
+    return InsideGuardBand(width_h * (position.x + 1), height_h * (1 + position.y));
+}
 
-                    float one_minus_t = 1 - t;
-                    t                 = t / v0.Position.w;
-                    one_minus_t       = one_minus_t / v1.Position.w;
+// Clipping shared by the main and the shadow pass, for a triangle that survived the trivial reject
+// Triangles crossing the near plane are clipped against it, those reaching out of the guard band against the four sides
+// of the screen too, the others are left alone. triangle(v0, v1, v2) is then called with the perspective divided fan
+// of whatever is left. stats may be null
+template <typename Triangle>
+static void ClipTriangle(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2,
+                         PipelineStatistics *stats, Triangle &&triangle)
+{
+    ClipPolygon polygon;
+    polygon.vertices[0] = v0;
+    polygon.vertices[1] = v1;
+    polygon.vertices[2] = v2;
+    polygon.count       = 3;
 
-                    inter.TexCoord    = (t * v1.TexCoord + one_minus_t * v0.TexCoord);
-                    inter.TexCoord    = inter.TexCoord * (1.0f / (t + one_minus_t));
+    if (v0.Position.z < 0 || v1.Position.z < 0 || v2.Position.z < 0)
+    {
+        if (stats)
+            stats->triangles_near_clipped++;
+        polygon.clip(CLIP_NEAR);
+    }
 
-                    inter.Color       = (t * v1.Color + one_minus_t * v0.Color);
-                    inter.Color       = inter.Color * (1.0f / (t + one_minus_t));
+    // In front of the near plane w is positive, the divide is safe
+    Platform platform = GetCurrentPlatform();
+    bool     inside   = true;
+    for (int32_t i = 0; i < polygon.count; ++i)
+        inside = inside && InsideGuardBand(platform, polygon.vertices[i].Position.PerspectiveDivide());
+    if (!inside)
+    {
+        if (stats)
+            stats->triangles_screen_clipped++;
+        polygon.clip(CLIP_SIDES);
+    }
 
-                    inter.FragPos     = (t * v1.FragPos + one_minus_t * v0.FragPos);
-                    inter.FragPos     = inter.FragPos * (1.0f / (t + one_minus_t));
-                }
-                else
-                {
-                    // Simple linear interpolation doesn't work here
-                    float t          = (inter.Position.y - v0.Position.y) / (v1.Position.y - v0.Position.y);
-                    inter.Position.w = v0.Position.w + t * (v1.Position.w - v0.Position.w);
+    if (polygon.count < 3)
+    {
+        if (stats)
+            stats->triangles_zero_area++;
+        return;
+    }
 
-                    // Depth, color_attributes and texture co-ordinates to be interpolated non-linearly
-                    inter.Position.z  = v0.Position.z + t * (v1.Position.z - v0.Position.z);
+    for (int32_t i = 0; i < polygon.count; ++i)
+        polygon.vertices[i].Position = polygon.vertices[i].Position.PerspectiveDivide();
+    for (int32_t i = 1; i + 1 < polygon.count; ++i)
+        triangle(polygon.vertices[0], polygon.vertices[i], polygon.vertices[i + 1]);
+}
 
-                    float one_minus_t = 1 - t;
-                    t                 = t / v0.Position.w;
-                    one_minus_t       = one_minus_t / v1.Position.w;
+static void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2, TriangleBins &bins,
+                   PipelineStatistics &stats)
+{
+    // Trivial reject is done beforehand, 4 triangles at a time by TrivialRejectMask
+    ClipTriangle(v0, v1, v2, &stats, [&](VertexAttrib3D const &a, VertexAttrib3D const &b, VertexAttrib3D const &c) {
+        Parallel::ScreenSpace(a, b, c, bins, stats);
+    });
+}
 
-                    inter.TexCoord    = (t * v1.TexCoord + one_minus_t * v0.TexCoord);
-                    inter.TexCoord    = inter.TexCoord * (1.0f / (t + one_minus_t));
+// Trivial reject of 4 triangles at once, p[j][k] being vertex j of triangle k in clip space
+// Bit k of the result is set if triangle k lies entirely outside one of the clip planes
+static uint32_t TrivialRejectMask(Vec4f const *const (&p)[3][4])
+{
+    auto   zero = _mm_setzero_ps();
+    auto   all  = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 outside[6] = {all, all, all, all, all, all};
+    for (int j = 0; j < 3; ++j)
+    {
+        // Vertices to one register per component
+        __m128 x = _mm_loadu_ps(&p[j][0]->x);
+        __m128 y = _mm_loadu_ps(&p[j][1]->x);
+        __m128 z = _mm_loadu_ps(&p[j][2]->x);
+        __m128 w = _mm_loadu_ps(&p[j][3]->x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        auto neg_w = _mm_sub_ps(zero, w);
+        outside[0] = _mm_and_ps(outside[0], _mm_cmplt_ps(x, neg_w));
+        outside[1] = _mm_and_ps(outside[1], _mm_cmpgt_ps(x, w));
+        outside[2] = _mm_and_ps(outside[2], _mm_cmplt_ps(y, neg_w));
+        outside[3] = _mm_and_ps(outside[3], _mm_cmpgt_ps(y, w));
+        outside[4] = _mm_and_ps(outside[4], _mm_cmplt_ps(z, zero));
+        outside[5] = _mm_and_ps(outside[5], _mm_cmpgt_ps(z, w));
+    }
+    auto rejected = _mm_or_ps(_mm_or_ps(_mm_or_ps(outside[0], outside[1]), _mm_or_ps(outside[2], outside[3])),
+                              _mm_or_ps(outside[4], outside[5]));
+    return _mm_movemask_ps(rejected);
+}
 
-                    inter.Color       = (t * v1.Color + one_minus_t * v0.Color);
-                    inter.Color       = inter.Color * (1.0f / (t + one_minus_t));
+// TrivialRejectMask for a single triangle, its vertices repeated in every lane
+static bool TriviallyRejected(Vec4f const &a, Vec4f const &b, Vec4f const &c)
+{
+    Vec4f const *const clip[3][4] = {{&a, &a, &a, &a}, {&b, &b, &b, &b}, {&c, &c, &c, &c}};
+    return TrivialRejectMask(clip) != 0;
+}
 
-                    inter.FragPos     = (t * v1.FragPos + one_minus_t * v0.FragPos);
-                    inter.FragPos     = inter.FragPos * (1.0f / (t + one_minus_t));
-                }
-                // Nothing done here .. Might revisit during texture mapping phase
-                // TODO -> Handle cases
-                // auto floatColor = Vec3f(v0.Color.x, v0.Color.y, v0.Color.z) + (inter.Position.x -
-                // v0.Position.x) /
-                //                                                                  (v1.Position.x -
-                //                                                                  v0.Position.x) * (v1.Color -
-                //                                                                  v0.Color);
-                outVertices.push_back(inter); // Pushes the intersection point
-                if (head)
-                    outVertices.push_back(v1);
-            }
-        }
-        vert++;
+// Frustum test of the bounding volumes of a renderable, clip being its object to clip space matrix
+// The clip volume is -w <= x, y <= w and 0 <= z <= w, each bound of it is a plane in object space once the matrix is
+// folded in. The sphere goes first, the box is only tested if the sphere straddles a plane. Both are conservative
+static bool InsideFrustum(Mat4f const &clip, BoundingBox const &box, BoundingSphere const &sphere)
+{
+    auto const &m = clip.mat;
+    float       planes[6][4];
+    for (int i = 0; i < 4; ++i)
+    {
+        planes[0][i] = m[3][i] + m[0][i]; // x >= -w
+        planes[1][i] = m[3][i] - m[0][i]; // x <= w
+        planes[2][i] = m[3][i] + m[1][i]; // y >= -w
+        planes[3][i] = m[3][i] - m[1][i]; // y <= w
+        planes[4][i] = m[2][i];           // z >= 0
+        planes[5][i] = m[3][i] - m[2][i]; // z <= w
     }
 
-    if (outVertices.size() < 3)
-        return;
+    auto const &c         = sphere.center;
+    bool        straddles = false;
+    for (auto const &p : planes)
+    {
+        float distance = p[0] * c.x + p[1] * c.y + p[2] * c.z + p[3];
+        float extent   = sphere.radius * std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        if (distance < -extent)
+            return false;
+        straddles |= distance < extent;
+    }
+    if (!straddles)
+        return true;
 
-    for (int vertex = 1; vertex < outVertices.size() - 1; vertex += 1)
+    // The box is outside a plane if its corner the farthest along the plane normal is
+    for (auto const &p : planes)
     {
-        Parallel::ScreenSpace(outVertices.at(0), outVertices.at(vertex),
-                              outVertices.at((vertex + 1) % outVertices.size()), XMinBound, XMaxBound);
+        float x = p[0] >= 0.0f ? box.max.x : box.min.x;
+        float y = p[1] >= 0.0f ? box.max.y : box.min.y;
+        float z = p[2] >= 0.0f ? box.max.z : box.min.z;
+        if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f)
+            return false;
     }
+    return true;
 }
 
-static void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2,
-                   MemAlloc<Pipeline3D::VertexAttrib3D> &allocator, int32_t XMinBound, int32_t XMaxBound)
+// Adds the wall clock time of the enclosing scope to busy, in milliseconds
+class BusyTimer
 {
-    // TODO :: SIMDify this
-    if (v0.Position.z > v0.Position.w && v1.Position.z > v1.Position.w && v2.Position.z > v2.Position.w)
-        return;
-    if (v0.Position.x < -v0.Position.w && v1.Position.x < -v1.Position.w && v2.Position.x < -v2.Position.w)
-        return;
-    if (v0.Position.x > v0.Position.w && v1.Position.x > v1.Position.w && v2.Position.x > v2.Position.w)
-        return;
-    if (v0.Position.y < -v0.Position.w && v1.Position.y < -v1.Position.w && v2.Position.y < -v2.Position.w)
-        return;
-    if (v0.Position.y > v0.Position.w && v1.Position.y > v1.Position.w && v2.Position.y > v2.Position.w)
-        return;
-    if (v0.Position.z > v0.Position.w && v1.Position.z > v1.Position.w && v2.Position.z > v2.Position.w)
-        return;
-    if (v0.Position.z < 0 && v1.Position.z < 0 && v2.Position.z < 0)
-        return;
-    std::vector<VertexAttrib3D, MemAlloc<VertexAttrib3D>> inVertices({v0, v1, v2}, allocator);
-    auto                                                  outVertices = inVertices;
+    double                               &busy;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    if (v0.Position.z < 0 || v1.Position.z < 0 || v2.Position.z < 0)
+  public:
+    explicit BusyTimer(double &busy) : busy{busy}
     {
-        outVertices.clear();
-        for (int i = 0; i < inVertices.size(); ++i)
-        {
-            //  __debugbreak();
-            auto const &v0   = inVertices.at(i);
-            auto const &v1   = inVertices.at((i + 1) % inVertices.size());
-            bool        head = v1.Position.z >= 0.0f;
-            // std::numeric_limits<float>::epsilon();
-            bool tail = v0.Position.z >= 0.0f;
-            // std::numeric_limits<float>::epsilon();
-            if (head && tail)
-                outVertices.push_back(v1); // <-- If both are inside the clipping near plane, add the head
-            else if (!(head || tail))
-                continue;
-            else
-            {
-                // <-- If any part is inside or outside, interpolate along the z axis, all parameters
-                // MayTODO :: Switch along different interpolation axis .. could be along w
-                //__debugbreak();
-                float          t  = (-v0.Position.z) / (v1.Position.z - v0.Position.z);
-                auto           pn = v0.Position + t * (v1.Position - v0.Position);
-                VertexAttrib3D vn;
-                vn.Position = pn;
-
-                vn.TexCoord = v0.TexCoord + t * (v1.TexCoord - v0.TexCoord);
-                vn.Color    = v0.Color + t * (v1.Color - v0.Color);
-                vn.FragPos  = v0.FragPos + t * (v1.FragPos - v0.FragPos);
-                outVertices.push_back(vn);
-                if (head)
-                    outVertices.push_back(v1);
-            }
-        }
     }
-    for (int vertex = 1; vertex < outVertices.size() - 1; vertex += 1)
+    ~BusyTimer()
     {
-        Parallel::ClipSpace2D(outVertices.at(0), outVertices.at(vertex),
-                              outVertices.at((vertex + 1) % outVertices.size()), allocator, XMinBound, XMaxBound);
+        busy += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
+};
+
+// Stores of the clear stage, count 32 bit values from dst on
+// Streaming stores need 16 byte alignment, the unaligned head goes through the caches like the tail
+template <bool stream> static void FillRow(void *dst, uint32_t value, size_t count)
+{
+    auto   out = static_cast<uint8_t *>(dst);
+    auto   v   = _mm_set1_epi32(static_cast<int>(value));
+    size_t i   = 0;
+    if constexpr (stream)
+    {
+        for (; i < count && (reinterpret_cast<uintptr_t>(out + 4 * i) & 15); ++i)
+            std::memcpy(out + 4 * i, &value, 4);
+        for (; i + 4 <= count; i += 4)
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + 4 * i), v);
+    }
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * i), v);
+    for (; i < count; ++i)
+        std::memcpy(out + 4 * i, &value, 4);
 }
 
-static void ParallelShadowMapper(RenderList &renderables, MemAlloc<Pipeline3D::VertexAttrib3D> &allocator,
-                                 int32_t XMinBound, int32_t XMaxBound)
+template <bool stream> static void CopyRow(void *dst, void const *src, size_t count)
+{
+    auto   out = static_cast<uint8_t *>(dst);
+    auto   in  = static_cast<uint8_t const *>(src);
+    size_t i   = 0;
+    if constexpr (stream)
+    {
+        for (; i < count && (reinterpret_cast<uintptr_t>(out + 4 * i) & 15); ++i)
+            std::memcpy(out + 4 * i, in + 4 * i, 4);
+        for (; i + 4 <= count; i += 4)
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + 4 * i),
+                             _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 4 * i)));
+    }
+    std::memcpy(out + 4 * i, in + 4 * i, 4 * (count - i));
+}
+
+// Columns [x0, x1) of the rows [y0, y1) of the colour and depth buffers, rows counted from the top like the tiles
+template <bool stream>
+static void ClearColorDepth(Platform const &platform, ParallelRenderer::ClearValues const &values, int32_t x0,
+                            int32_t x1, int32_t y0, int32_t y1)
+{
+    auto const &cb    = platform.colorBuffer;
+    auto const &zb    = platform.zBuffer;
+    auto        depth = std::bit_cast<uint32_t>(values.depth);
+    assert(cb.noChannels == 4);
+    for (int32_t h = y0; h < y1; ++h)
+    {
+        // Colour rows are stored bottom up
+        size_t offset = (size_t(cb.height - 1 - h) * cb.width + x0) * cb.noChannels;
+        if (values.background)
+            CopyRow<stream>(cb.buffer + offset, values.background + offset, x1 - x0);
+        else
+            FillRow<stream>(cb.buffer + offset, values.color, x1 - x0);
+        FillRow<stream>(zb.buffer + size_t(h) * zb.width + x0, depth, x1 - x0);
+    }
+}
+
+static void ParallelShadowMapper(RenderList &renderables, ParallelRenderer const &renderer, int32_t XMinBound,
+                                 int32_t XMaxBound, int32_t YMinBound, int32_t YMaxBound)
 {
     VertexAttrib3D v0, v1, v2;
-    auto           lightOrtho = OrthoProjection(-5.0f, 5.0f, -5.0f, 5.0f, -5.0f, 5.0f);
-    // assume light position is directly above the origin, we haves
-    auto light     = get_light_source();
-    auto lightView = lookAtMatrix(light.position, Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
-    for (auto const &renderable : renderables.Renderables)
+    // Light space positions come from the vertex pass
+    for (size_t r = 0; r < renderables.Renderables.size(); ++r)
     {
+        if (!renderer.casts_shadow(r))
+            continue;
+        auto const &renderable  = renderables.Renderables[r];
+        auto        transformed = renderer.get_post_transformed(r);
         for (std::size_t i = 0; i < renderable.indices.size(); i += 3)
         {
-            allocator.resource->reset();
             v0          = renderable.vertices[renderable.indices[i]];
             v1          = renderable.vertices[renderable.indices[i + 1]];
             v2          = renderable.vertices[renderable.indices[i + 2]];
 
-            v0.Position = lightOrtho * lightView * renderable.model_transform * v0.Position;
-            v1.Position = lightOrtho * lightView * renderable.model_transform * v1.Position;
-            v2.Position = lightOrtho * lightView * renderable.model_transform * v2.Position;
+            v0.Position = transformed[renderable.indices[i]].light;
+            v1.Position = transformed[renderable.indices[i + 1]].light;
+            v2.Position = transformed[renderable.indices[i + 2]].light;
 
-            ShadowMapper::Clip3D(v0, v1, v2, allocator, XMinBound, XMaxBound);
+            ShadowMapper::Clip3D(v0, v1, v2, XMinBound, XMaxBound, YMinBound, YMaxBound);
         }
     }
 }
@@ -869,16 +1184,73 @@ void ParallelTypeErasedShadow(void *arg)
     auto drawArgs = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
     /*ParallelDraw(*drawArgs->vertex_vector, *drawArgs->index_vector, *drawArgs->matrix, *drawArgs->allocator,
                  drawArgs->XMinBound, drawArgs->XMaxBound);*/
-    ParallelShadowMapper(*drawArgs->render_list, *drawArgs->allocator, drawArgs->XMinBound, drawArgs->XMaxBound);
+    BusyTimer busy(drawArgs->renderer->partition_timings[drawArgs->partition].shadow_pass);
+    ParallelShadowMapper(*drawArgs->render_list, *drawArgs->renderer, drawArgs->XMinBound, drawArgs->XMaxBound,
+                         drawArgs->YMinBound, drawArgs->YMaxBound);
 }
 
 
-static void ParallelRenderableDraw(RenderList &renderables, MemAlloc<Pipeline3D::VertexAttrib3D> &allocator,
-                                   int32_t XMinBound, int32_t XMaxBound)
+// Vertex pass
+// Every thread transforms a contiguous range of the vertices of the whole render list into the post-transform buffer
+// Matrices are concatenated once per renderable beforehand, so this is one matrix vector product per output
+void ParallelTypeErasedVertex(void *arg)
+{
+    auto      drawArgs   = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
+    auto     &renderer   = *drawArgs->renderer;
+    auto     &renderable = drawArgs->render_list->Renderables;
+    BusyTimer busy(renderer.partition_timings[drawArgs->partition].vertex_pass);
+
+    // Clear stage, every job takes the same share of each buffer
+    if (renderer.clear_mode != ParallelRenderer::ClearMode::NONE)
+    {
+        BusyTimer   clearing(renderer.partition_timings[drawArgs->partition].clear_pass);
+        auto        platform = GetCurrentPlatform();
+        auto const &sm       = platform.shadowMap;
+        uint32_t    i = drawArgs->partition, n = renderer.no_of_partitions;
+        size_t      s0 = size_t(sm.height) * i / n, s1 = size_t(sm.height) * (i + 1) / n;
+        FillRow<true>(sm.buffer + s0 * sm.width, std::bit_cast<uint32_t>(renderer.clear_values.shadow),
+                      (s1 - s0) * sm.width);
+        if (renderer.clear_mode == ParallelRenderer::ClearMode::EAGER)
+        {
+            // Whole tile rows, so no two partitions clear the same tile
+            int32_t y0 = vMin<int32_t>(renderer.tiles_y * i / n * tile_size, renderer.screen_height);
+            int32_t y1 = vMin<int32_t>(renderer.tiles_y * (i + 1) / n * tile_size, renderer.screen_height);
+            ClearColorDepth<true>(platform, renderer.clear_values, 0, renderer.screen_width, y0, y1);
+        }
+        // Streaming stores are weakly ordered, they must be visible before the job signals its counter
+        _mm_sfence();
+    }
+
+    size_t vertices   = renderer.post_transform.size();
+    size_t first      = vertices * drawArgs->partition / renderer.no_of_partitions;
+    size_t last       = vertices * (drawArgs->partition + 1) / renderer.no_of_partitions;
+
+    for (size_t r = 0; r < renderable.size(); ++r)
+    {
+        auto const &transform = renderer.transforms[r];
+        if (!transform.visible && !transform.casts_shadow)
+            continue;
+        size_t      base      = transform.vertex_base;
+        size_t      begin     = vMax(first, base);
+        size_t      end       = vMin(last, base + renderable[r].vertices.size());
+        for (size_t v = begin; v < end; ++v)
+        {
+            auto const &position       = renderable[r].vertices[v - base].Position;
+            renderer.post_transform[v] = PostTransformVertex{transform.model * position, transform.clip * position,
+                                                             transform.light * position};
+        }
+    }
+}
+
+// Setup stage of the main pass
+// Every thread takes a contiguous range [first, last) of the triangles of the whole render list, so vertex and clip
+// work is done exactly once per triangle, and bins whatever survives
+static void ParallelRenderableSetup(RenderList &renderables, ParallelRenderer const &renderer, size_t first,
+                                    size_t last, TriangleBins &bins, MemAlloc<BinnedTriangle> const &allocator,
+                                    PipelineStatistics &stats)
 {
     VertexAttrib3D v0, v1, v2;
-    // Run the whole pipeline simultaneously on multiple threads
-    auto device = GetRasteriserDevice();
+    bins.reset(allocator);
     // For depth mapping, it should be made 2 pass rendering ..
     // We can call 2 pass on per triangle basis or as a whole
     // Lets try the whole pipeline method first
@@ -907,104 +1279,473 @@ static void ParallelRenderableDraw(RenderList &renderables, MemAlloc<Pipeline3D:
     //    }
     //}
 
-    for (auto const &renderable : renderables.Renderables)
+    size_t base = 0; // index of the first triangle of the current renderable, culled renderables don't count
+    for (size_t r = 0; r < renderables.Renderables.size(); ++r)
     {
-        device->Context.ActiveMergeMode = renderable.merge_mode;
-        if (renderable.merge_mode == RenderDevice::MergeMode::TEXTURE_MODE)
-            SetActiveTexture(renderable.textureID);
+        if (!renderer.is_visible(r))
+            continue;
+        auto const &renderable  = renderables.Renderables[r];
+        auto        transformed = renderer.get_post_transformed(r);
         assert(renderable.indices.size() % 3 == 0);
+        size_t offset = base;
+        base += renderable.indices.size() / 3;
+        if (last <= offset || first >= base)
+            continue;
+        size_t begin = vMax(first, offset) - offset;
+        size_t end   = vMin(last, base) - offset;
+
+        bins.merge_mode = renderable.merge_mode;
+        bins.textureID  = renderable.textureID;
         // First step rendering
 
-        for (std::size_t i = 0; i < renderable.indices.size(); i += 3)
+        auto const &indices = renderable.indices;
+        for (std::size_t t = begin; t < end; t += 4)
         {
-            allocator.resource->reset();
-            v0 = renderable.vertices[renderable.indices[i]];
-            v1 = renderable.vertices[renderable.indices[i + 1]];
-            v2 = renderable.vertices[renderable.indices[i + 2]];
-
-            // Allow passing of model and perspective matrix seperately
-            v0.FragPos = renderable.model_transform * v0.Position;
-            v1.FragPos = renderable.model_transform * v1.Position;
-            v2.FragPos = renderable.model_transform * v2.Position;
-            // Am I an idiot? -> Yes, apparently I am.
-
-            v0.Position = renderable.scene_transform * renderable.model_transform * v0.Position;
-            v1.Position = renderable.scene_transform * renderable.model_transform * v1.Position;
-            v2.Position = renderable.scene_transform * renderable.model_transform * v2.Position;
-
-            // Only use the model transform to transform the fragPos vectors ... They aren't subjected to
-            // perspective projection Nature doesn't work depending on how our eyes perceive the effect .. Its
-            // absolute
-
-            Parallel::Clip3D(v0, v1, v2, allocator, XMinBound, XMaxBound);
+            // Trivial reject goes 4 triangles at a time, a short batch repeats its last triangle in the spare lanes
+            uint32_t     batch = static_cast<uint32_t>(vMin<size_t>(4, end - t));
+            Vec4f const *clip[3][4];
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                size_t i = (t + vMin(k, batch - 1)) * 3;
+                for (int j = 0; j < 3; ++j)
+                    clip[j][k] = &transformed[indices[i + j]].clip;
+            }
+            uint32_t rejected = TrivialRejectMask(clip) & ((1u << batch) - 1);
+            stats.triangles_submitted += batch;
+            stats.triangles_trivially_rejected += std::popcount(rejected);
+
+            for (uint32_t k = 0; k < batch; ++k)
+            {
+                if (rejected & (1u << k))
+                    continue;
+                size_t i = (t + k) * 3;
+                v0 = renderable.vertices[indices[i]];
+                v1 = renderable.vertices[indices[i + 1]];
+                v2 = renderable.vertices[indices[i + 2]];
+
+                // Gather the positions transformed by the vertex pass
+                // Only the model transform is applied to the fragPos vectors ... They aren't subjected to
+                // perspective projection Nature doesn't work depending on how our eyes perceive the effect .. Its
+                // absolute
+                v0.FragPos  = transformed[indices[i]].world;
+                v1.FragPos  = transformed[indices[i + 1]].world;
+                v2.FragPos  = transformed[indices[i + 2]].world;
+
+                v0.Position = *clip[0][k];
+                v1.Position = *clip[1][k];
+                v2.Position = *clip[2][k];
+
+                Parallel::Clip3D(v0, v1, v2, bins, stats);
+            }
         }
     }
 }
 
 // Try packing all these arguments
-void ParallelTypeErasedDraw(void *arg)
+void ParallelTypeErasedSetup(void *arg)
 {
     // Retrieve back the type erased information
-    auto drawArgs = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
-    /*ParallelDraw(*drawArgs->vertex_vector, *drawArgs->index_vector, *drawArgs->matrix, *drawArgs->allocator,
-                 drawArgs->XMinBound, drawArgs->XMaxBound);*/
-    ParallelRenderableDraw(*drawArgs->render_list, *drawArgs->allocator, drawArgs->XMinBound, drawArgs->XMaxBound);
+    auto      drawArgs = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
+    auto     &renderer = *drawArgs->renderer;
+    BusyTimer busy(renderer.partition_timings[drawArgs->partition].binning_pass);
+
+    size_t    triangles = 0;
+    auto  &renderables = drawArgs->render_list->Renderables;
+    for (size_t r = 0; r < renderables.size(); ++r)
+    {
+        if (renderer.is_visible(r))
+            triangles += renderables[r].indices.size() / 3;
+    }
+
+    auto   partitions = renderer.no_of_partitions;
+    size_t first      = triangles * drawArgs->partition / partitions;
+    size_t last       = triangles * (drawArgs->partition + 1) / partitions;
+    ParallelRenderableSetup(*drawArgs->render_list, renderer, first, last, renderer.bins[drawArgs->partition],
+                            *drawArgs->allocator, *drawArgs->statistics);
+}
+
+// Tile stage of the main pass
+// Threads keep pulling whole tiles until none is left, so a thread that got cheap tiles simply takes more of them
+void ParallelTypeErasedTileRaster(void *arg)
+{
+    auto        drawArgs = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
+    auto const &renderer = *drawArgs->renderer;
+    BusyTimer   busy(drawArgs->renderer->partition_timings[drawArgs->partition].raster_pass);
+    auto       &stats    = *drawArgs->statistics;
+    auto        platform = GetCurrentPlatform();
+    auto        tiles    = static_cast<uint32_t>(renderer.tiles_x * renderer.tiles_y);
+    auto const *uniforms = &renderer.uniforms;
+
+    for (uint32_t tile = drawArgs->next_tile->fetch_add(1, std::memory_order_relaxed); tile < tiles;
+         tile          = drawArgs->next_tile->fetch_add(1, std::memory_order_relaxed))
+    {
+        int32_t XMinBound = (tile % renderer.tiles_x) * tile_size;
+        int32_t YMinBound = (tile / renderer.tiles_x) * tile_size;
+        int32_t XMaxBound = vMin<int32_t>(XMinBound + tile_size, platform.width) - 1;
+        int32_t YMaxBound = vMin<int32_t>(YMinBound + tile_size, platform.height) - 1;
+
+        if (renderer.clear_mode == ParallelRenderer::ClearMode::LAZY)
+        {
+            BusyTimer clearing(drawArgs->renderer->partition_timings[drawArgs->partition].clear_pass);
+            ClearColorDepth<false>(platform, renderer.clear_values, XMinBound, XMaxBound + 1, YMinBound,
+                                   YMaxBound + 1);
+        }
+
+        auto   &depth     = drawArgs->renderer->tile_depth[tile];
+        depth.reset(XMinBound, XMaxBound, YMinBound, YMaxBound);
+
+        VisibilitySample *visibility = nullptr;
+        if (renderer.shading_mode == ParallelRenderer::ShadingMode::DEFERRED)
+        {
+            visibility = drawArgs->renderer->visibility.data();
+            for (int32_t h = YMinBound; h <= YMaxBound; ++h)
+                std::fill(visibility + h * platform.width + XMinBound, visibility + h * platform.width + XMaxBound + 1,
+                          VisibilitySample{VisibilitySample::empty});
+        }
+
+        // Walk the bins in thread order, each of them being in submission order, to preserve draw order
+        for (uint32_t partition = 0; partition < renderer.no_of_partitions; ++partition)
+        {
+            auto const &bins = renderer.bins[partition];
+            for (auto index : bins.tiles[tile])
+            {
+                auto const &tri = bins.triangles[index];
+                if (vMin(tri.v0.z, tri.v1.z, tri.v2.z) >= depth.tile_max)
+                {
+                    stats.tiles_depth_culled++;
+                    continue;
+                }
+                Parallel::Rasteriser(tri, XMinBound, XMaxBound, YMinBound, YMaxBound, *uniforms, depth, visibility,
+                                     VisibilitySample::id(partition, index), stats);
+            }
+        }
+    }
+}
+
+void ParallelTypeErasedResolve(void *arg)
+{
+    auto        drawArgs = static_cast<Parallel::ParallelRenderer::ParallelThreadArgStruct *>(arg);
+    auto const &renderer = *drawArgs->renderer;
+    BusyTimer   busy(drawArgs->renderer->partition_timings[drawArgs->partition].shading_pass);
+    auto       &stats    = *drawArgs->statistics;
+    auto        platform = GetCurrentPlatform();
+    auto const &cb       = platform.colorBuffer;
+    auto        tiles    = static_cast<uint32_t>(renderer.tiles_x * renderer.tiles_y);
+    auto const &uniforms = renderer.uniforms;
+
+    for (uint32_t tile = drawArgs->next_tile->fetch_add(1, std::memory_order_relaxed); tile < tiles;
+         tile          = drawArgs->next_tile->fetch_add(1, std::memory_order_relaxed))
+    {
+        int32_t         XMinBound = (tile % renderer.tiles_x) * tile_size;
+        int32_t         YMinBound = (tile / renderer.tiles_x) * tile_size;
+        int32_t         XMaxBound = vMin<int32_t>(XMinBound + tile_size, platform.width) - 1;
+        int32_t         YMaxBound = vMin<int32_t>(YMinBound + tile_size, platform.height) - 1;
+
+        // Neighbouring pixels mostly come from the same triangle, its shading constants are only set up again when the
+        // triangle changes
+        TriangleShading shading;
+        uint32_t        current = VisibilitySample::empty;
+        for (int32_t h = YMinBound; h <= YMaxBound; ++h)
+        {
+            for (int32_t w = XMinBound; w <= XMaxBound; ++w)
+            {
+                auto const &sample = renderer.visibility[h * platform.width + w];
+                if (sample.triangle == VisibilitySample::empty)
+                    continue;
+                if (sample.triangle != current)
+                {
+                    current = sample.triangle;
+                    SetupShading(uniforms, renderer.bins[sample.partition()].triangles[sample.index()], shading);
+                }
+
+                auto const &tri = *shading.tri;
+                float       a[4];
+                a[3]           = (1.0f - sample.b1 - sample.b2) * tri.v0.inv_w;
+                a[2]           = sample.b1 * tri.v1.inv_w;
+                a[1]           = sample.b2 * tri.v2.inv_w;
+                float bary_sum = a[3] + a[2] + a[1];
+
+                stats.fragments_shaded++;
+                ShadeFragment(uniforms, shading, a, bary_sum, platform,
+                              cb.buffer + ((cb.height - 1 - h) * cb.width + w) * cb.noChannels);
+            }
+        }
+    }
 }
 
 // Parallel Renderer class definition
-ParallelRenderer::ParallelRenderer(const int width, const int height)
+ParallelRenderer::ParallelRenderer(const int width, const int height, uint32_t partitions)
 {
+    assert(partitions >= 1 && partitions <= max_partitions);
     // Change of idea
     // We will partition the screen into 4 vertical segments where each thread will work on each thread
     // It will make checking for y co-ordinates redundant
-    boundary[0]   = 0;
-    int32_t first = width / no_of_partitions;
+    no_of_partitions = partitions;
+    screen_width     = width;
+    screen_height    = height;
+    partition();
+
+    tiles_x          = (width + tile_size - 1) / tile_size;
+    tiles_y          = (height + tile_size - 1) / tile_size;
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+        bins[i].resize(tiles_x, tiles_y);
+    tile_depth.resize(tiles_x * tiles_y);
+    visibility.resize(width * height);
+}
 
-    for (auto i = 1; i < no_of_partitions; ++i)
-        boundary[i] = i * first;
+void ParallelRenderer::first_touch(Jobs::Scheduler &scheduler)
+{
+    // Best effort only, the tile pass pulls tiles from a shared counter so no worker owns a region of the screen. The
+    // thread rendering a tile is usually not the one that touched its pages, spreading them over the nodes of the
+    // workers at least keeps them from all landing on the node of the allocating thread
+    auto platform = GetCurrentPlatform();
+    scheduler.parallel_for(0, tiles_y, 1, [&](size_t first, size_t last) {
+        int32_t y0 = static_cast<int32_t>(first) * tile_size;
+        int32_t y1 = vMin<int32_t>(static_cast<int32_t>(last) * tile_size, screen_height);
+        for (int32_t h = y0; h < y1; ++h)
+        {
+            auto const &zb = platform.zBuffer;
+            auto const &cb = platform.colorBuffer;
+            std::fill_n(visibility.data() + h * screen_width, screen_width, VisibilitySample{VisibilitySample::empty});
+            if (h < int32_t(zb.height))
+                std::fill_n(zb.buffer + h * zb.width, zb.width, 0.0f);
+            if (h < int32_t(cb.height))
+                std::fill_n(cb.buffer + h * cb.width * cb.noChannels, cb.width * cb.noChannels, uint8_t(0));
+        }
+        for (size_t tile = first * tiles_x; tile < last * tiles_x; ++tile)
+            tile_depth[tile] = TileDepth{};
+    });
+    scheduler.parallel_for(0, platform.shadowMap.height, tile_size, [&](size_t first, size_t last) {
+        std::fill(platform.shadowMap.buffer + first * platform.shadowMap.width,
+                  platform.shadowMap.buffer + last * platform.shadowMap.width, 0.0f);
+    });
+}
 
-    boundary[no_of_partitions] = width;
+void ParallelRenderer::partition()
+{
+    uint32_t columns = 1;
+    uint32_t rows    = 1;
+    switch (partition_type)
+    {
+    case PartitionType::HORIZONTAL:
+        rows = no_of_partitions;
+        break;
+    case PartitionType::VERTICAL:
+    case PartitionType::ADAPTIVE:
+        columns = no_of_partitions;
+        break;
+    case PartitionType::EQUAL_GRID:
+    {
+        // Divisor of the partition count whose cells come closest to square
+        double ideal = std::sqrt(double(no_of_partitions) * screen_width / vMax(screen_height, 1));
+        for (uint32_t c = 1; c <= no_of_partitions; ++c)
+        {
+            if (no_of_partitions % c == 0 && std::abs(c - ideal) < std::abs(columns - ideal))
+                columns = c;
+        }
+        rows = no_of_partitions / columns;
+        break;
+    }
+    }
+
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+    {
+        int32_t column = i % columns;
+        int32_t row    = i / columns;
+        boxes[i]       = BBox{screen_width * column / int32_t(columns), screen_height * row / int32_t(rows),
+                        screen_width * (column + 1) / int32_t(columns) - 1,
+                        screen_height * (row + 1) / int32_t(rows) - 1};
+    }
+}
+
+void ParallelRenderer::rebalance()
+{
+    // Cost of a strip is taken as spread evenly over its width, new boundaries split the total cost in equal shares
+    // Boundaries only move half way there, the timings of a single frame are noisy
+    double cost[max_partitions];
+    double total = 0.0;
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+        total += cost[i] = partition_timings[i].shadow_pass;
+    if (total <= 0.0)
+        return;
+
+    int32_t  x[max_partitions + 1];
+    uint32_t strip  = 0;
+    double   before = 0.0; // cost of the strips left of strip
+    x[0]            = 0;
+    for (uint32_t i = 1; i < no_of_partitions; ++i)
+    {
+        double target = total * i / no_of_partitions;
+        while (strip + 1 < no_of_partitions && before + cost[strip] < target)
+            before += cost[strip++];
+        auto const &box      = boxes[strip];
+        double      fraction = cost[strip] > 0.0 ? (target - before) / cost[strip] : 0.0;
+        int32_t     split    = box.x0 + static_cast<int32_t>(fraction * (box.x1 + 1 - box.x0));
+        x[i]                 = boxes[i].x0 + (split - boxes[i].x0) / 2;
+    }
+    x[no_of_partitions] = screen_width;
+
+    // Narrower than min_strip when that many strips don't fit the screen, else the clamp below can't hold both bounds
+    int32_t narrowest = vMin(min_strip, screen_width / int32_t(no_of_partitions));
+    for (uint32_t i = 1; i < no_of_partitions; ++i)
+        x[i] = vMin(vMax(x[i], x[i - 1] + narrowest), screen_width - int32_t(no_of_partitions - i) * narrowest);
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+    {
+        // Overlapping boxes would have two shadow jobs writing the same texels
+        assert(x[i] + narrowest <= x[i + 1]);
+        boxes[i] = BBox{x[i], 0, x[i + 1] - 1, screen_height - 1};
+    }
+}
+
+PipelineStatistics ParallelRenderer::get_pipeline_statistics() const
+{
+    // Setup splits triangles and the tile pass splits tiles between partitions, so every counter is a plain sum
+    PipelineStatistics total{};
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+        total += statistics[i];
+    return total;
+}
+
+void ParallelRenderer::SubmitPass(Jobs::Scheduler &scheduler, Jobs::JobFuncPtr fn, ParallelThreadArgStruct *args,
+                                  Jobs::Job *jobs, Jobs::Counter &counter, Jobs::Counter *after)
+{
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+        jobs[i] = Jobs::Job{fn, &args[i]};
+    scheduler.submit(jobs, no_of_partitions, counter, after);
 }
 
 void ParallelRenderer::AlternativeParallelRenderablePipeline(
-    Alternative::ThreadPool &thread_pool, RenderList &renderables,
+    Jobs::Scheduler &scheduler, RenderList &renderables,
     std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator)
 {
-    std::latch waiter(no_of_partitions);
-    // Allocate objects on the stack
-    ParallelThreadArgStruct args[no_of_partitions];
+    BeginFrame(scheduler, renderables, allocator);
+    EndFrame();
+}
+
+void ParallelRenderer::BeginFrame(Jobs::Scheduler &scheduler, RenderList &renderables,
+                                  std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator)
+{
+    assert(!in_flight);
+    assert(allocator.size() > no_of_partitions);
+    if (!frame)
+        frame = std::make_unique<FrameJobs>();
+    frame->started_at = std::chrono::steady_clock::now();
+    frame->scheduler  = &scheduler;
+    frame->next_tile  = 0;
+    in_flight         = true;
+
+    // Strips of the adaptive partition follow the cost of the last frame, before its timings are reset
+    if (partition_type == PartitionType::ADAPTIVE)
+        rebalance();
 
     for (auto i : std::ranges::iota_view(1u, no_of_partitions + 1))
     {
-        args[i - 1] = ParallelThreadArgStruct(&renderables, &allocator[i], boundary[i - 1], boundary[i]);
+        auto const &box          = boxes[i - 1];
+        statistics[i - 1]        = PipelineStatistics{};
+        partition_timings[i - 1] = PassTimings{};
+        frame->args[i - 1]       = ParallelThreadArgStruct(&renderables, &allocator[i], box.x0, box.x1, box.y0,
+                                                           box.y1, &statistics[i - 1], this, i - 1, &frame->next_tile);
     }
 
-    // operate on passive ptr here
-    auto count = 0u;
-    for (auto &task : *thread_pool.get_passive_ptr())
+    // Light and camera don't change while the frame renders, every pass reads them from the uniforms
+    // The device is thread local, the workers get the copy of the calling thread's uniforms instead
+    auto &context = GetRasteriserDevice()->Context;
+    context.SetFrameUniforms(get_light_source(), get_camera_position());
+    uniforms = context.Uniforms;
+
+    // Concatenate the matrices of every renderable and lay out the post-transform buffer
+
+    // Whole renderables outside the view frustum skip the vertex and the main pass, outside the light frustum the
+    // shadow pass. Cheap enough for the calling thread, counted in the statistics of the first partition
+    // At most one entry per renderable, reserved up front so that a renderable coming into view doesn't grow them
+    transforms.clear();
+    transforms.reserve(renderables.Renderables.size());
+    frame->pinned.reserve(renderables.Renderables.size());
+    size_t vertices = 0;
+    for (auto const &renderable : renderables.Renderables)
     {
-        /*task = Alternative::ThreadPool::AlternativeTaskDesc{
-            false, Alternative::ThreadPool::ThreadPoolFunc(Parallel::ParallelTypeErasedDraw, &args[count++])};*/
-        task.completed = false;
-        // task.task      = Alternative::ThreadPool::ThreadPoolFunc(Parallel::ParallelTypeErasedDraw, &args[count++]);
-        task.task      = Alternative::ThreadPool::ThreadPoolFunc(Parallel::ParallelTypeErasedShadow, &args[count++]);
+        auto clip         = renderable.scene_transform * renderable.model_transform;
+        auto light        = uniforms.lightTransform * renderable.model_transform;
+        bool visible      = InsideFrustum(clip, renderable.bounding_box, renderable.bounding_sphere);
+        bool casts_shadow = InsideFrustum(light, renderable.bounding_box, renderable.bounding_sphere);
+        transforms.push_back(
+            RenderableTransforms{renderable.model_transform, clip, light, vertices, visible, casts_shadow});
+        vertices += renderable.vertices.size();
+        if (!visible)
+        {
+            statistics[0].renderables_frustum_culled++;
+            statistics[0].triangles_frustum_culled += renderable.indices.size() / 3;
+        }
+        // Textures stay resident until the frame has been rendered, the manager can't evict them under the workers
+        else if (renderable.merge_mode != RenderDevice::MergeMode::COLOR_MODE && renderable.textureID &&
+                 GetTextureManager().Pin(renderable.textureID))
+            frame->pinned.push_back(renderable.textureID);
     }
-    // Every thread must wait until the generation of the shadow mapping
+    post_transform.resize(vertices);
+
+    // Shadow and binning passes only need the transformed vertices, they are queued right away behind the vertex pass
+    // and run together. Tiles need both the bins and the shadow map, the tail waits for the shadow pass
+    auto &f = *frame;
+    SubmitPass(scheduler, Parallel::ParallelTypeErasedVertex, f.args, f.jobs[0], f.transformed);
+    SubmitPass(scheduler, Parallel::ParallelTypeErasedShadow, f.args, f.jobs[1], f.shadowed, &f.transformed);
+    // Main pass is sort-middle : every triangle is set up and binned once, then tiles are rasterised independently
+    SubmitPass(scheduler, Parallel::ParallelTypeErasedSetup, f.args, f.jobs[2], f.binned, &f.transformed);
+    f.tail = Jobs::Job{FrameTail, this};
+    scheduler.submit(&f.tail, 1, f.finished, &f.binned);
+}
 
-    thread_pool.started(&waiter);
-    thread_pool.wait_till_finished();
+void ParallelRenderer::FrameTail(void *arg)
+{
+    auto &renderer  = *static_cast<ParallelRenderer *>(arg);
+    auto &f         = *renderer.frame;
+    auto &scheduler = *f.scheduler;
+    scheduler.wait(f.shadowed);
+
+    renderer.SubmitPass(scheduler, Parallel::ParallelTypeErasedTileRaster, f.args, f.jobs[3], f.rastered);
+    scheduler.wait(f.rastered);
+
+    if (renderer.shading_mode == ShadingMode::DEFERRED)
+    {
+        f.next_tile = 0;
+        renderer.SubmitPass(scheduler, Parallel::ParallelTypeErasedResolve, f.args, f.jobs[4], f.resolved);
+        scheduler.wait(f.resolved);
+    }
+}
 
-    std::latch newwaiter(no_of_partitions);
-    count = 0u;
-    for (auto &task : *thread_pool.get_passive_ptr())
+void ParallelRenderer::EndFrame()
+{
+    assert(in_flight);
+    auto &f = *frame;
+    f.scheduler->wait(f.finished);
+    in_flight = false;
+
+    for (auto texture : f.pinned)
+        GetTextureManager().Unpin(texture);
+    f.pinned.clear();
+
+    // Scratch of the frame is dropped all at once, the arenas keep their chunks for the next one
+    for (uint32_t i = 0; i < no_of_partitions; ++i)
+        f.args[i].allocator->resource->end_frame();
+
+    // Timed from the counters, the caller may have come back late
+    bool deferred             = shading_mode == ShadingMode::DEFERRED;
+    auto main_end             = deferred ? f.resolved.finished_at : f.rastered.finished_at;
+    auto main_start           = f.transformed.finished_at;
+    auto raster_start         = vMax(f.shadowed.finished_at, f.binned.finished_at);
+    auto shading_start        = f.rastered.finished_at;
+    auto ms                   = [](auto span) { return std::chrono::duration<double, std::milli>(span).count(); };
+    last_timings.vertex_pass  = ms(main_start - f.started_at);
+    last_timings.shadow_pass  = ms(f.shadowed.finished_at - main_start);
+    last_timings.binning_pass = ms(f.binned.finished_at - main_start);
+    last_timings.raster_pass  = ms(shading_start - raster_start);
+    last_timings.shading_pass = deferred ? ms(main_end - shading_start) : 0.0;
+    last_timings.main_pass    = ms(main_end - main_start);
+    last_timings.clear_pass   = 0.0;
+    for (auto &timings : partition_timings)
     {
-        /*task = Alternative::ThreadPool::AlternativeTaskDesc{
-            false, Alternative::ThreadPool::ThreadPoolFunc(Parallel::ParallelTypeErasedDraw, &args[count++])};*/
-        task.completed = false;
-        task.task      = Alternative::ThreadPool::ThreadPoolFunc(Parallel::ParallelTypeErasedDraw, &args[count++]);
+        timings.main_pass       = timings.binning_pass + timings.raster_pass + timings.shading_pass;
+        last_timings.clear_pass = vMax(last_timings.clear_pass, timings.clear_pass);
     }
-    thread_pool.started(&newwaiter);
-    thread_pool.wait_till_finished();
 }
 
 } // namespace Parallel
@@ -1015,138 +1756,38 @@ using namespace Pipeline3D;
 // woaahhh .. need to duplicate clip3d, screen space, and clip2d also
 
 static void ShadowMappingRasteriser(Pipeline3D::RasterInfo const &v0, Pipeline3D::RasterInfo const &v1,
-                                    Pipeline3D::RasterInfo const &v2, int32_t XMinBound, int32_t XMaxBound)
+                                    Pipeline3D::RasterInfo const &v2, int32_t XMinBound, int32_t XMaxBound,
+                                    int32_t YMinBound, int32_t YMaxBound)
 {
     // This rasteriser will only map depth values, nothing else
     Platform platform = GetCurrentPlatform();
 
-    auto     Device   = GetRasteriserDevice();
-    int32_t  minX     = vMax(vMin(v0.x, v1.x, v2.x), XMinBound);
-    int32_t  maxX     = vMin(vMax(v0.x, v1.x, v2.x), XMaxBound);
-
-    int      minY     = vMin(v0.y, v1.y, v2.y);
-    int      maxY     = vMax(v0.y, v1.y, v2.y);
-
-    // Assume vectors are in clockwise ordering
-    Vec2  p0   = Vec2(v1.x, v1.y) - Vec2(v0.x, v0.y);
-    Vec2  p1   = Vec2(v2.x, v2.y) - Vec2(v1.x, v1.y);
-    Vec2  p2   = Vec2(v0.x, v0.y) - Vec2(v2.x, v2.y);
-
-    Vec2  vec0 = Vec2(v0.x, v0.y);
-    Vec2  vec1 = Vec2(v1.x, v1.y);
-    Vec2  vec2 = Vec2(v2.x, v2.y);
-
-    float area = Vec2<int>::Determinant(p1, p0);
-
-    // Perspective depth interpolation, perspective correct texture interpolation ....
-    Vec2 point = Vec2(minX, minY);
-    // Start collecting points from here
-
-    float a1_ = Vec2<int32_t>::Determinant(point - vec0, p0);
-    float a2_ = Vec2<int32_t>::Determinant(point - vec1, p1);
-    float a3_ = Vec2<int32_t>::Determinant(point - vec2, p2);
-
-    // Read to process 4 pixels at a time
-    SIMD::Vec4ss a1_vec  = SIMD::Vec4ss(a1_, a1_ + p0.y, a1_ + 2 * p0.y, a1_ + 3 * p0.y);
-    SIMD::Vec4ss a2_vec  = SIMD::Vec4ss(a2_, a2_ + p1.y, a2_ + 2 * p1.y, a2_ + 3 * p1.y);
-    SIMD::Vec4ss a3_vec  = SIMD::Vec4ss(a3_, a3_ + p2.y, a3_ + 2 * p2.y, a3_ + 3 * p2.y);
-
-    SIMD::Vec4ss inc_a1  = SIMD::Vec4ss(4 * p0.y);
-    SIMD::Vec4ss inc_a2  = SIMD::Vec4ss(4 * p1.y);
-    SIMD::Vec4ss inc_a3  = SIMD::Vec4ss(4 * p2.y);
-
-    SIMD::Vec4ss inc_a1_ = SIMD::Vec4ss(-p0.x);
-    SIMD::Vec4ss inc_a2_ = SIMD::Vec4ss(-p1.x);
-    SIMD::Vec4ss inc_a3_ = SIMD::Vec4ss(-p2.x);
-
-    SIMD::Vec4ss a1, a2, a3;
-    SIMD::Vec4ss zvec(v0.z / area, v1.z / area, v2.z / area, 0.0f);
-    // zvec = zvec;
-    // Now processing downwards
-    auto          inv_w     = SIMD::Vec4ss(v0.inv_w / area, v1.inv_w / area, v2.inv_w / area, 0.0f);
-    constexpr int hStepSize = 4;
-
-    for (size_t h = minY; h <= maxY; ++h)
-    {
-        a1 = a1_vec;
-        a2 = a2_vec;
-        a3 = a3_vec;
-
-        for (size_t w = minX; w <= maxX; w += hStepSize)
-        {
-            auto mask = SIMD::Vec4ss::generate_nmask(a1, a2, a3);
-            if (mask > 0)
-            {
-                auto depth = &platform.shadowMap.buffer[h * platform.shadowMap.width + w];
-                using namespace SIMD;
-                auto   zero = _mm_setzero_ps();
-                __m128 a    = _mm_unpackhi_ps(a2.vec, a1.vec);
-                __m128 b    = _mm_unpackhi_ps(zero, a3.vec);
-                __m128 c    = _mm_unpacklo_ps(a2.vec, a1.vec);
-                __m128 d    = _mm_unpacklo_ps(zero, a3.vec);
-
-                // Lol shuffle ni garna parxa tw
-                auto lvec1 = Vec4ss(_mm_movehl_ps(a, b));
-                auto lvec2 = Vec4ss(_mm_movelh_ps(b, a));
-
-                auto lvec3 = Vec4ss(_mm_movehl_ps(c, d));
-                auto lvec4 = Vec4ss(_mm_movelh_ps(d, c));
-
-                lvec1      = Vec4ss(_mm_shuffle_ps(lvec1.vec, lvec1.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                lvec2      = Vec4ss(_mm_shuffle_ps(lvec2.vec, lvec2.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                lvec3      = Vec4ss(_mm_shuffle_ps(lvec3.vec, lvec3.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                lvec4      = Vec4ss(_mm_shuffle_ps(lvec4.vec, lvec4.vec, _MM_SHUFFLE(2, 1, 3, 0)));
-                if (mask & 0x08)
-                {
-                    float z = lvec1.dot(zvec);
-                    if (z < depth[0])
-                        depth[0] = z;
-                }
+    TriangleEdges edges;
+    if (!SetupEdges(v0, v1, v2, XMinBound, vMin<int32_t>(XMaxBound, platform.shadowMap.width - 1), YMinBound,
+                    vMin<int32_t>(YMaxBound, platform.shadowMap.height - 1), edges))
+        return;
+    float area = edges.area;
 
-                if (mask & 0x04)
-                {
-                    float z = lvec2.dot(zvec);
-                    if (z < depth[1])
-                        depth[1] = z;
-                }
-                if (mask & 0x02)
-                {
-                    float z = lvec3.dot(zvec);
-                    if (z < depth[2])
-                        depth[2] = z;
-                }
-                if (mask & 0x01)
-                {
-                    // plot fourth pixel
-                    float z = lvec4.dot(zvec);
-                    if (z < depth[3])
-                        depth[3] = z;
-                }
-            }
+    Vec3f zplane = Vec3f(v0.z, v1.z, v2.z) * (1.0f / area);
 
-            a1 = a1 + inc_a1;
-            a2 = a2 + inc_a2;
-            a3 = a3 + inc_a3;
-        }
-        a1_vec = a1_vec + inc_a1_;
-        a2_vec = a2_vec + inc_a2_;
-        a3_vec = a3_vec + inc_a3_;
-    }
+    // Only depth is written
+    ForEachCoveredQuad(edges, zplane, platform.shadowMap.buffer, platform.shadowMap.width, nullptr, 0.0f, nullptr,
+                       [](int32_t, int32_t, uint32_t, QuadFragments const &) {});
 }
 
 static void ScreenSpace(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2, int32_t XMinBound,
-                        int32_t XMaxBound)
+                        int32_t XMaxBound, int32_t YMinBound, int32_t YMaxBound)
 {
     Platform platform = GetCurrentPlatform();
     int      width_h  = (platform.width - 1) / 2;
     int      height_h = (platform.height - 1) / 2;
-    int      x0       = static_cast<int>(width_h * (v0.Position.x + 1));
-    int      x1       = static_cast<int>(width_h * (v1.Position.x + 1));
-    int      x2       = static_cast<int>(width_h * (v2.Position.x + 1));
+    int      x0       = Parallel::SnapToSubpixel(width_h * (v0.Position.x + 1));
+    int      x1       = Parallel::SnapToSubpixel(width_h * (v1.Position.x + 1));
+    int      x2       = Parallel::SnapToSubpixel(width_h * (v2.Position.x + 1));
 
-    int      y0       = static_cast<int>(height_h * (1 + v0.Position.y));
-    int      y1       = static_cast<int>(height_h * (1 + v1.Position.y));
-    int      y2       = static_cast<int>(height_h * (1 + v2.Position.y));
+    int      y0       = Parallel::SnapToSubpixel(height_h * (1 + v0.Position.y));
+    int      y1       = Parallel::SnapToSubpixel(height_h * (1 + v1.Position.y));
+    int      y2       = Parallel::SnapToSubpixel(height_h * (1 + v2.Position.y));
 
     float    z0       = v0.Position.z;
     float    z1       = v1.Position.z;
@@ -1157,173 +1798,18 @@ static void ScreenSpace(VertexAttrib3D const &v0, VertexAttrib3D const &v1, Vert
     RasterInfo rs1(x1, y1, z1, v1.Position.w, v1.TexCoord, v1.Color, v1.FragPos);
     RasterInfo rs2(x2, y2, z2, v2.Position.w, v2.TexCoord, v2.Color, v2.FragPos);
 
-    ShadowMapper::ShadowMappingRasteriser(rs0, rs1, rs2, XMinBound, XMaxBound);
+    ShadowMapper::ShadowMappingRasteriser(rs0, rs1, rs2, XMinBound, XMaxBound, YMinBound, YMaxBound);
 }
 
-static void ClipSpace2D(VertexAttrib3D v0, VertexAttrib3D v1, VertexAttrib3D v2, MemAlloc<VertexAttrib3D> &allocator,
-                        int32_t XMinBound, int32_t XMaxBound)
+void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2, int32_t XMinBound,
+            int32_t XMaxBound, int32_t YMinBound, int32_t YMaxBound)
 {
-    // The position data should be interpolated and passed before the perspective division phase
-
-    v0.Position = v0.Position.PerspectiveDivide();
-    v1.Position = v1.Position.PerspectiveDivide();
-    v2.Position = v2.Position.PerspectiveDivide();
-
-    std::vector<VertexAttrib3D, MemAlloc<VertexAttrib3D>> outVertices({v0, v1, v2}, allocator);
-    auto                                                  inVertices = outVertices;
-
-    std::vector<Vec2f, MemAlloc<Vec2f>>                   clipPoly(
-                          {Vec2(-1.0f, 1.0f), Vec2(-1.0f, -1.0f), Vec2(1.0f, -1.0f), Vec2(1.0f, 1.0f)}, allocator);
-
-    std::vector<Vec2f, MemAlloc<Vec2f>> clipLines(clipPoly.size(), allocator);
-
-    for (int i = 0; i < clipPoly.size(); ++i)
-        clipLines.at(i) = clipPoly.at((i + 1) % clipPoly.size()) - clipPoly.at(i);
-
-    size_t vert = 0;
-    outVertices.clear();
-    outVertices = {v0, v1, v2};
-
-    vert        = 0;
-    for (const auto &line : clipLines)
-    {
-        if (outVertices.size() == 1)
-            break;
-        inVertices = outVertices;
-        // If single point remained, discard it
-        outVertices.clear();
-
-        for (size_t i = 0; i < inVertices.size(); ++i)
-        {
-            auto const &v0 = inVertices.at(i), v1 = inVertices.at((i + 1) % inVertices.size());
-
-            auto head = Vec2<float>::Determinant(line, Vec2f(v1.Position.x, v1.Position.y) - clipPoly[vert]) >= 0;
-            auto tail = Vec2<float>::Determinant(line, Vec2f(v0.Position.x, v0.Position.y) - clipPoly[vert]) >= 0;
-
-            if (head && tail)
-                outVertices.push_back(v1);
-            else if (!(head || tail))
-                continue;
-            else
-            {
-                // This edge is divided by the clip line
-                auto intersection =
-                    LineIntersect(clipPoly[vert], clipPoly[vert] + line, Vec2f(v0.Position.x, v0.Position.y),
-                                  Vec2f(v1.Position.x, v1.Position.y));
-                auto point1 = clipPoly[vert] + line * intersection.x;
-                auto point2 =
-                    Vec2f(v0.Position.x, v0.Position.y) +
-                    (Vec2f(v1.Position.x, v1.Position.y) - Vec2f(v0.Position.x, v0.Position.y)) * intersection.y;
-
-                // point1 and point2 are same and are the intersection obtained by clipping against the clipping
-                // Poly Since they lie on the edge of the triangle, vertex attributes can be linearly
-                // interpolated across those two vertices
-                VertexAttrib3D inter;
-                inter.Position = Vec4f(point1, 0.0f, 1.0f); // <-- Todo
-
-                if (fabs(v1.Position.x - v0.Position.x) > fabs(v1.Position.y - v0.Position.y))
-                {
-                    // Use alternative interpolating scheme here
-                    float t = (inter.Position.x - v0.Position.x) / (v1.Position.x - v0.Position.x);
-                    // Interpolate depth, color_attributes and texture co-ordinates here
-                    // Interplate z/w linearly too
-                    inter.Position.w = v0.Position.w + t * (v1.Position.w - v0.Position.w);
-
-                    // Depth linearly, color_attributes and texture co-ordinates to be interpolated non-linearly
-                    inter.Position.z  = v0.Position.z + t * (v1.Position.z - v0.Position.z);
-
-                    float one_minus_t = 1 - t;
-                    t                 = t / v0.Position.w;
-                    one_minus_t       = one_minus_t / v1.Position.w;
-                }
-                else
-                {
-                    // Simple linear interpolation doesn't work here
-                    float t          = (inter.Position.y - v0.Position.y) / (v1.Position.y - v0.Position.y);
-                    inter.Position.w = v0.Position.w + t * (v1.Position.w - v0.Position.w);
-
-                    // Depth, color_attributes and texture co-ordinates to be interpolated non-linearly
-                    inter.Position.z  = v0.Position.z + t * (v1.Position.z - v0.Position.z);
-
-                    float one_minus_t = 1 - t;
-                    t                 = t / v0.Position.w;
-                    one_minus_t       = one_minus_t / v1.Position.w;
-                }
-                outVertices.push_back(inter); // Pushes the intersection point
-                if (head)
-                    outVertices.push_back(v1);
-            }
-        }
-        vert++;
-    }
-
-    if (outVertices.size() < 3)
-        return;
-
-    for (int vertex = 1; vertex < outVertices.size() - 1; vertex += 1)
-    {
-        ShadowMapper::ScreenSpace(outVertices.at(0), outVertices.at(vertex),
-                                  outVertices.at((vertex + 1) % outVertices.size()), XMinBound, XMaxBound);
-    }
-}
-
-void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2,
-                   MemAlloc<Pipeline3D::VertexAttrib3D> &allocator, int32_t XMinBound, int32_t XMaxBound)
-{
-    if (v0.Position.z > v0.Position.w && v1.Position.z > v1.Position.w && v2.Position.z > v2.Position.w)
-        return;
-    if (v0.Position.x < -v0.Position.w && v1.Position.x < -v1.Position.w && v2.Position.x < -v2.Position.w)
-        return;
-    if (v0.Position.x > v0.Position.w && v1.Position.x > v1.Position.w && v2.Position.x > v2.Position.w)
-        return;
-    if (v0.Position.y < -v0.Position.w && v1.Position.y < -v1.Position.w && v2.Position.y < -v2.Position.w)
+    if (Parallel::TriviallyRejected(v0.Position, v1.Position, v2.Position))
         return;
-    if (v0.Position.y > v0.Position.w && v1.Position.y > v1.Position.w && v2.Position.y > v2.Position.w)
-        return;
-    if (v0.Position.z > v0.Position.w && v1.Position.z > v1.Position.w && v2.Position.z > v2.Position.w)
-        return;
-    if (v0.Position.z < 0 && v1.Position.z < 0 && v2.Position.z < 0)
-        return;
-    std::vector<VertexAttrib3D, MemAlloc<VertexAttrib3D>> inVertices({v0, v1, v2}, allocator);
-    auto                                                  outVertices = inVertices;
-
-    if (v0.Position.z < 0 || v1.Position.z < 0 || v2.Position.z < 0)
-    {
-        outVertices.clear();
-        for (int i = 0; i < inVertices.size(); ++i)
-        {
-            //  __debugbreak();
-            auto const &v0   = inVertices.at(i);
-            auto const &v1   = inVertices.at((i + 1) % inVertices.size());
-            bool        head = v1.Position.z >= 0.0f;
-            // std::numeric_limits<float>::epsilon();
-            bool tail = v0.Position.z >= 0.0f;
-            // std::numeric_limits<float>::epsilon();
-            if (head && tail)
-                outVertices.push_back(v1); // <-- If both are inside the clipping near plane, add the head
-            else if (!(head || tail))
-                continue;
-            else
-            {
-                // <-- If any part is inside or outside, interpolate along the z axis, all parameters
-                // MayTODO :: Switch along different interpolation axis .. could be along w
-                //__debugbreak();
-                float          t  = (-v0.Position.z) / (v1.Position.z - v0.Position.z);
-                auto           pn = v0.Position + t * (v1.Position - v0.Position);
-                VertexAttrib3D vn;
-                vn.Position = pn;
-
-                outVertices.push_back(vn);
-                if (head)
-                    outVertices.push_back(v1);
-            }
-        }
-    }
-    for (int vertex = 1; vertex < outVertices.size() - 1; vertex += 1)
-    {
-        ShadowMapper::ClipSpace2D(outVertices.at(0), outVertices.at(vertex),
-                                  outVertices.at((vertex + 1) % outVertices.size()), allocator, XMinBound, XMaxBound);
-    }
+    Parallel::ClipTriangle(v0, v1, v2, nullptr,
+                           [&](VertexAttrib3D const &a, VertexAttrib3D const &b, VertexAttrib3D const &c) {
+                               ShadowMapper::ScreenSpace(a, b, c, XMinBound, XMaxBound, YMinBound, YMaxBound);
+                           });
 }
 
 } // namespace ShadowMapper
@@ -1,39 +1,336 @@
 #pragma once
 #include "../include/rasteriser.h"
 #include "../include/render.h"
+#include "./job_system.h"
 #include "./thread_pool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <span>
+
 namespace Parallel
 {
-void ParallelTypeErasedDraw(void *arg);
+
+// Counters similar to GPU pipeline statistics queries
+// Each partition owns one copy, padded to its own cache line, so counting never contends between threads
+struct alignas(64) PipelineStatistics
+{
+    // Whole renderables outside the view frustum, and the triangles they hold, skipped before any triangle work
+    uint64_t renderables_frustum_culled   = 0;
+    uint64_t triangles_frustum_culled     = 0;
+
+    // Front end, per triangle
+    uint64_t triangles_submitted          = 0;
+    uint64_t triangles_trivially_rejected = 0; // completely outside one of the clip planes
+    uint64_t triangles_near_clipped       = 0;
+    uint64_t triangles_screen_clipped     = 0; // outside the guard band, went through the screen edge clipper
+    uint64_t triangles_backface_culled    = 0; // wrong winding after screen mapping, rasteriser would cover nothing
+    uint64_t triangles_zero_area          = 0; // clipped away by the screen edges or degenerate after snapping
+
+    // Coarse depth, per triangle and tile / per triangle and 8x8 block skipped without reading the z-buffer
+    uint64_t tiles_depth_culled           = 0;
+    uint64_t depth_blocks_culled          = 0;
+
+    // Back end, per step of the active SIMD coverage kernel and per fragment
+    uint64_t blocks_tested                = 0;
+    uint64_t fragments_covered            = 0;
+    uint64_t fragments_passed_depth       = 0;
+    uint64_t fragments_shaded             = 0;
+
+    PipelineStatistics &operator+=(PipelineStatistics const &stats)
+    {
+        renderables_frustum_culled += stats.renderables_frustum_culled;
+        triangles_frustum_culled += stats.triangles_frustum_culled;
+        triangles_submitted += stats.triangles_submitted;
+        triangles_trivially_rejected += stats.triangles_trivially_rejected;
+        triangles_near_clipped += stats.triangles_near_clipped;
+        triangles_screen_clipped += stats.triangles_screen_clipped;
+        triangles_backface_culled += stats.triangles_backface_culled;
+        triangles_zero_area += stats.triangles_zero_area;
+        tiles_depth_culled += stats.tiles_depth_culled;
+        depth_blocks_culled += stats.depth_blocks_culled;
+        blocks_tested += stats.blocks_tested;
+        fragments_covered += stats.fragments_covered;
+        fragments_passed_depth += stats.fragments_passed_depth;
+        fragments_shaded += stats.fragments_shaded;
+        return *this;
+    }
+};
+
+// Screen space vertices are snapped to 28.4 fixed point, so RasterInfo::x and y are in 1/16 pixel in this pipeline
+// Pixels are sampled at the integer positions, multiples of subpixel_one
+constexpr int32_t subpixel_bits = 4;
+constexpr int32_t subpixel_one  = 1 << subpixel_bits;
+
+inline int32_t    SnapToSubpixel(float pixel)
+{
+    return static_cast<int32_t>(std::lrint(pixel * subpixel_one));
+}
+
+// Guard band : triangles whose screen space vertices are all within guard_band pixels of the origin skip the screen
+// edge clipper, the rasteriser clamps their bounding box to the screen or the tile instead
+// Inside a bounding box every edge function value is bounded by 32 * (2 * guard_band)^2 in 28.4 units, the limit keeps
+// that within int32. Triangles reaching further, and those crossing the near plane, are still clipped
+constexpr float guard_band = 4000.0f;
+
+inline bool     InsideGuardBand(float x, float y)
+{
+    return std::fabs(x) <= guard_band && std::fabs(y) <= guard_band;
+}
+
+// Sort-middle binning
+// Triangles are transformed, clipped and set up once, by whichever thread owns them, then appended to the bins of every
+// screen tile their bounding box touches. Rasterisation then works tile by tile, so a tile's color and depth stay in
+// cache and no thread walks triangles that can't touch its pixels
+constexpr int32_t tile_size = 64;
+
+struct BinnedTriangle
+{
+    Pipeline3D::RasterInfo  v0, v1, v2;
+    // Shading state is captured at setup, rasterisation no longer runs in renderable order
+    RenderDevice::MergeMode merge_mode;
+    uint32_t                textureID;
+};
+
+// Output of the setup stage of one thread
+// Bins store indices into triangles, kept in submission order so that the tile pass stays deterministic
+// Triangles and tile lists live in the frame arena of the partition and go away with it at the end of the frame
+struct TriangleBins
+{
+    using Tile = std::vector<uint32_t, MemAlloc<uint32_t>>;
+    std::vector<BinnedTriangle, MemAlloc<BinnedTriangle>> triangles;
+    std::vector<Tile>                                     tiles;
+    int32_t                                               tiles_x = 0;
+    int32_t                                               tiles_y = 0;
+
+    // Current renderable's state, stamped on every binned triangle
+    RenderDevice::MergeMode                               merge_mode;
+    uint32_t                                              textureID;
+
+    void                                                  resize(int32_t x_tiles, int32_t y_tiles)
+    {
+        tiles_x = x_tiles;
+        tiles_y = y_tiles;
+        tiles.resize(tiles_x * tiles_y);
+    }
+
+    // Starts the bins of a frame in the given arena, the storage of the last frame has been released with its arena
+    // Every list is reserved as large as it was last frame, a growing list would leave its old copies behind in the
+    // arena
+    void reset(MemAlloc<BinnedTriangle> const &allocator)
+    {
+        auto count = triangles.size();
+        triangles  = decltype(triangles)(allocator);
+        triangles.reserve(count);
+        for (auto &tile : tiles)
+        {
+            count = tile.size();
+            tile  = Tile(allocator);
+            tile.reserve(count);
+        }
+    }
+
+    void bin(Pipeline3D::RasterInfo const &v0, Pipeline3D::RasterInfo const &v1, Pipeline3D::RasterInfo const &v2)
+    {
+        int32_t tx0 = std::clamp((vMin(v0.x, v1.x, v2.x) >> subpixel_bits) / tile_size, 0, tiles_x - 1);
+        int32_t tx1 = std::clamp((vMax(v0.x, v1.x, v2.x) >> subpixel_bits) / tile_size, 0, tiles_x - 1);
+        int32_t ty0 = std::clamp((vMin(v0.y, v1.y, v2.y) >> subpixel_bits) / tile_size, 0, tiles_y - 1);
+        int32_t ty1 = std::clamp((vMax(v0.y, v1.y, v2.y) >> subpixel_bits) / tile_size, 0, tiles_y - 1);
+
+        auto    index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(BinnedTriangle{v0, v1, v2, merge_mode, textureID});
+        for (int32_t ty = ty0; ty <= ty1; ++ty)
+            for (int32_t tx = tx0; tx <= tx1; ++tx)
+                tiles[ty * tiles_x + tx].push_back(index);
+    }
+};
+
+// Coarse depth of one tile
+// Each 8x8 block keeps an upper bound of its z-buffer values and the tile the bound of its blocks. A triangle whose
+// nearest depth isn't in front of a bound fails the depth test everywhere below it, so that block, or the whole tile,
+// is skipped without reading the z-buffer. Bounds start at +inf every frame and are tightened from the z-buffer after
+// each triangle that wrote into a block, which keeps them valid whatever the z-buffer was cleared to
+// Blocks never straddle tiles and a tile is only rasterised by one thread, so no locking is needed
+constexpr int32_t depth_block_size = 8;
+constexpr int32_t tile_blocks      = tile_size / depth_block_size; // per side
+static_assert(tile_blocks * tile_blocks == 64, "dirty blocks of a tile are tracked in one 64 bit mask");
+
+struct alignas(64) TileDepth
+{
+    float   block_max[tile_blocks * tile_blocks];
+    float   tile_max;
+    // Pixels of the tile, clipped to the screen
+    int32_t x0, x1, y0, y1;
+
+    void    reset(int32_t XMinBound, int32_t XMaxBound, int32_t YMinBound, int32_t YMaxBound)
+    {
+        x0 = XMinBound;
+        x1 = XMaxBound;
+        y0 = YMinBound;
+        y1 = YMaxBound;
+        for (int32_t by = 0; by < tile_blocks; ++by)
+        {
+            for (int32_t bx = 0; bx < tile_blocks; ++bx)
+            {
+                // Blocks hanging off the screen hold no pixel, they must not keep the tile bound open
+                bool inside = x0 + bx * depth_block_size <= x1 && y0 + by * depth_block_size <= y1;
+                block_max[by * tile_blocks + bx] =
+                    inside ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+            }
+        }
+        tile_max = std::numeric_limits<float>::infinity();
+    }
+
+    // Block (bx, by) in tile local block coordinates
+    float block(int32_t bx, int32_t by) const
+    {
+        return block_max[by * tile_blocks + bx];
+    }
+
+    // Recomputes the bounds of the blocks set in dirty from the z-buffer
+    void refresh(uint64_t dirty, float const *zbuffer, int32_t zwidth)
+    {
+        // Depth only ever decreases, so the tile bound only moves if one of the blocks holding it did
+        bool stale = false;
+        for (; dirty; dirty &= dirty - 1)
+        {
+            int32_t index = std::countr_zero(dirty);
+            int32_t bx0   = x0 + (index % tile_blocks) * depth_block_size;
+            int32_t by0   = y0 + (index / tile_blocks) * depth_block_size;
+            int32_t bx1   = vMin(bx0 + depth_block_size - 1, x1);
+            int32_t by1   = vMin(by0 + depth_block_size - 1, y1);
+            float   bound = -std::numeric_limits<float>::infinity();
+            for (int32_t h = by0; h <= by1; ++h)
+                for (int32_t w = bx0; w <= bx1; ++w)
+                    bound = vMax(bound, zbuffer[h * zwidth + w]);
+            stale            = stale || block_max[index] == tile_max;
+            block_max[index] = bound;
+        }
+        if (stale)
+            tile_max = *std::max_element(block_max, block_max + tile_blocks * tile_blocks);
+    }
+};
+
+// Visibility buffer texel, written by the tile pass in deferred shading mode
+// Enough to find the triangle again and rebuild the fragment, shading itself happens once per pixel in the resolve pass
+struct VisibilitySample
+{
+    constexpr static uint32_t empty          = ~0u;
+    constexpr static uint32_t partition_bits = 6;
+
+    // No default values, so the buffer can be allocated without touching it. Cleared texels are {empty}
+    uint32_t                  triangle; // index in the bins of its partition, partition in the low bits
+    float                     b1;       // screen space barycentrics of v1 and v2, v0 gets the rest
+    float                     b2;
+
+    // Triangles a bin may hold, the last index with every partition bit set would read as empty
+    constexpr static uint32_t max_index      = (1u << (32 - partition_bits)) - 1;
+
+    static uint32_t           id(uint32_t partition, uint32_t index)
+    {
+        assert(partition < (1u << partition_bits) && index < max_index);
+        return index << partition_bits | partition;
+    }
+    uint32_t partition() const
+    {
+        return triangle & ((1u << partition_bits) - 1);
+    }
+    uint32_t index() const
+    {
+        return triangle >> partition_bits;
+    }
+};
+
+// Post-transform vertex
+// Each unique vertex of a renderable is transformed once per frame, shadow and main pass only gather these by index
+struct PostTransformVertex
+{
+    Vec4f world; // model_transform * position, used as fragment position for shading
+    Vec4f clip;  // scene_transform * model_transform * position
+    Vec4f light; // light space position for the shadow pass
+};
+
+void ParallelTypeErasedVertex(void *arg);
+void ParallelTypeErasedSetup(void *arg);
+void ParallelTypeErasedTileRaster(void *arg);
+void ParallelTypeErasedResolve(void *arg);
+
 // Lets implement poor man's feedback complete signal
 
 class ParallelRenderer
 {
-    // Maybe thread pool isn't required here explicitly, if all threads will continuously work on each region
-    // Optimal partition of screen into threads -> To decide
-    // Each time screen buffer changes ParallelRendered need to be remodified
-    // Only the rasteriser stage will be parallelized for now
-    // I guess it should take thread pool as input to initiate parallel operation during Rasterisation
-    constexpr static uint32_t no_of_partitions = Alternative::ThreadPool::N; // or number of threads
+  public:
+    // Every pass is split into one job per partition, run by the workers of the job system and the submitting thread
+    // Partition count is set at construction, usually to the thread count of the scheduler
+    constexpr static uint32_t max_partitions = 1u << VisibilitySample::partition_bits;
+
+    // Screen regions of the partitions, used by the shadow pass, the main pass hands its tiles out as threads get free
+    // ADAPTIVE starts as VERTICAL and moves the strip boundaries every frame, so that every strip costs the same
     enum class PartitionType
     {
         HORIZONTAL,
         VERTICAL,
-        EQUAL_GRID
+        EQUAL_GRID,
+        ADAPTIVE
     };
-    PartitionType parition_type = PartitionType::VERTICAL;
-    // Lets start with equal_grid for now
+
+  private:
+    // Maybe thread pool isn't required here explicitly, if all threads will continuously work on each region
+    // Optimal partition of screen into threads -> To decide
+    // Each time screen buffer changes ParallelRendered need to be remodified
+    // Only the rasteriser stage will be parallelized for now
+    // I guess it should take thread pool as input to initiate parallel operation during Rasterisation
+    uint32_t      no_of_partitions = 1;
+    PartitionType partition_type   = PartitionType::VERTICAL;
+    // Narrowest strip the adaptive partition may shrink to, in pixels, less if the partitions don't fit the screen
+    constexpr static int32_t min_strip = 8;
 
     // Need bounding box for each grids
-    bool completed_rendering[no_of_partitions] = {false};
+    bool completed_rendering[max_partitions] = {false};
 
+    // Inclusive pixel bounds of a partition, the boxes of all partitions tile the screen without overlap
     struct BBox
     {
         int x0, y0, x1, y1;
     };
-    BBox    boxes[no_of_partitions];
-    int32_t boundary[no_of_partitions + 1];
+    BBox    boxes[max_partitions];
+    int32_t screen_width  = 0;
+    int32_t screen_height = 0;
+
+    // Tile grid for the main pass, one set of bins per thread so that setup never needs a lock
+    int32_t      tiles_x = 0;
+    int32_t      tiles_y = 0;
+    TriangleBins bins[max_partitions];
+    // Coarse depth of every tile, reset by the tile pass as it picks the tile up
+    std::vector<TileDepth, DefaultInitAllocator<TileDepth>>               tile_depth;
+    // Deferred shading only, one sample per pixel, cleared by the tile pass like the coarse depth
+    std::vector<VisibilitySample, DefaultInitAllocator<VisibilitySample>> visibility;
+    // Frame constants of the shading stage, set before the first pass of every frame
+    FrameUniforms                                                         uniforms{};
+
+    // Post-transform buffer of the current frame, vertices of every renderable packed one after the other
+    struct RenderableTransforms
+    {
+        Mat4f  model;
+        Mat4f  clip;
+        Mat4f  light;
+        size_t vertex_base;
+        bool   visible;      // bounds inside the view frustum, drawn by the main pass
+        bool   casts_shadow; // bounds inside the light frustum, drawn by the shadow pass
+    };
+    std::vector<RenderableTransforms> transforms;
+    std::vector<PostTransformVertex>  post_transform;
+
+    friend void                       ParallelTypeErasedVertex(void *arg);
+    friend void                       ParallelTypeErasedShadow(void *arg);
+    friend void                       ParallelTypeErasedSetup(void *arg);
+    friend void                       ParallelTypeErasedTileRaster(void *arg);
+    friend void                       ParallelTypeErasedResolve(void *arg);
 
   public:
     // Arg address struct
@@ -47,34 +344,210 @@ class ParallelRenderer
         MemAlloc<Pipeline3D::VertexAttrib3D> *allocator;
         int32_t                               XMinBound;
         int32_t                               XMaxBound;
+        int32_t                               YMinBound;
+        int32_t                               YMaxBound;
+        PipelineStatistics                   *statistics;
+        // For the binned main pass
+        ParallelRenderer                     *renderer;
+        uint32_t                              partition;
+        std::atomic<uint32_t>                *next_tile;
+    };
+
+    // Wall clock time spent in each pass of the last rendered frame, in milliseconds
+    // Shadow and binning passes run at the same time, both are timed from the end of the vertex pass
+    struct PassTimings
+    {
+        double vertex_pass  = 0.0;
+        double shadow_pass  = 0.0;
+        double main_pass    = 0.0; // end of the vertex pass to the end of the frame
+        double binning_pass = 0.0;
+        double raster_pass  = 0.0;
+        double shading_pass = 0.0; // deferred resolve, 0 in forward mode
+        double clear_pass   = 0.0; // busy time clearing, inside the vertex pass (and the raster pass when lazy)
+    };
+
+    // FORWARD shades every fragment passing the depth test as it is rasterised, overdrawn ones included
+    // DEFERRED only writes triangle IDs and barycentrics into a visibility buffer while rasterising, then a resolve
+    // pass shades each visible pixel once, so shading cost follows the resolution instead of the overdraw
+    enum class ShadingMode
+    {
+        FORWARD,
+        DEFERRED
+    };
+
+    // Who clears the colour buffer, depth buffer and shadow map of the platform at the start of a frame
+    // NONE leaves it to the caller. EAGER clears all three at the start of the vertex pass, every job a band of rows
+    // of each buffer, with non-temporal stores that don't evict what the passes work on from the caches
+    // LAZY only clears the shadow map there, the tile pass clears the colour and depth of a tile as it picks the tile
+    // up, with plain stores since the tile gets rasterised right after
+    enum class ClearMode
+    {
+        NONE,
+        EAGER,
+        LAZY
     };
 
+    struct ClearValues
+    {
+        uint32_t       color      = 0;       // one pixel of the colour buffer, as it is laid out in memory
+        uint8_t const *background = nullptr; // frame sized image laid out like the colour buffer, replaces color
+        float          depth      = 1.0f;
+        float          shadow     = 1.0f;
+    };
+
+  private:
+    PassTimings        last_timings{};
+    // Busy time of the job of every partition in every pass, main_pass being the sum of the last three
+    // Spread between partitions is time the frame waits on the slowest one
+    PassTimings        partition_timings[max_partitions]{};
+    ShadingMode        shading_mode = ShadingMode::FORWARD;
+    ClearMode          clear_mode   = ClearMode::NONE;
+    ClearValues        clear_values{};
+    PipelineStatistics statistics[max_partitions];
+
+    // Jobs and counters of the frame in flight, they must not move until EndFrame while the renderer itself may
+    struct FrameJobs
+    {
+        ParallelThreadArgStruct               args[max_partitions];
+        std::atomic<uint32_t>                 next_tile{0};
+        Jobs::Scheduler                      *scheduler = nullptr;
+        Jobs::Job                             jobs[5][max_partitions];
+        Jobs::Job                             tail;
+        Jobs::Counter                         transformed, shadowed, binned, rastered, resolved, finished;
+        std::chrono::steady_clock::time_point started_at;
+        std::vector<uint32_t>                 pinned; // textures, see TextureManager::Pin
+    };
+    std::unique_ptr<FrameJobs> frame;
+    bool                       in_flight = false;
+
+  public:
     ParallelRenderer() = default;
-    ParallelRenderer(const int width, const int height);
+    ParallelRenderer(const int width, const int height, uint32_t partitions);
 
     // This program will launch rasteriser on all 4 threads with some preparation
     // What preparation don't know yet
 
-    void ParallelPipeline(ThreadPool &thread_pool, std::vector<Pipeline3D::VertexAttrib3D> const &vertex_vector,
-                          std::vector<uint32_t> const &index_vector, Mat4f const &matrix,
-                          std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator);
-    void AlternativeParallelPipeline(Alternative::ThreadPool                       &thread_pool,
-                                     std::vector<Pipeline3D::VertexAttrib3D> const &vertex_vector,
-                                     std::vector<uint32_t> const &index_vector, Mat4f const &matrix,
-                                     std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator);
-
     void reset_rendering_status()
     {
-        std::fill_n(completed_rendering, 4, false);
+        std::fill_n(completed_rendering, no_of_partitions, false);
     }
 
     bool done_rendering()
     {
-        return std::all_of(completed_rendering, completed_rendering + 4, [](bool x) { return x; });
+        return std::all_of(completed_rendering, completed_rendering + no_of_partitions, [](bool x) { return x; });
     }
 
-    void AlternativeParallelRenderablePipeline(Alternative::ThreadPool &thread_pool, RenderList &renderables,
+    // Renders a frame, returns once it is done
+    void AlternativeParallelRenderablePipeline(Jobs::Scheduler &scheduler, RenderList &renderables,
                                                std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator);
+
+    // Same frame split in two, so the caller can work on the next frame while this one renders
+    // BeginFrame copies everything the passes read from the scene, matrices into the transforms and light and camera
+    // into the uniforms, so transforms, camera and light may change as soon as it returns. Geometry, textures, the
+    // render list itself and the settings of the renderer must stay as they are until EndFrame
+    void BeginFrame(Jobs::Scheduler &scheduler, RenderList &renderables,
+                    std::vector<MemAlloc<Pipeline3D::VertexAttrib3D>> &allocator);
+    // Waits for the frame started by BeginFrame, timings and statistics are valid after it
+    void EndFrame();
+
+    bool frame_in_flight() const
+    {
+        return in_flight;
+    }
+
+    // Writes the color buffer, depth buffer and shadow map of the platform and the tile buffers from the workers, a
+    // few tile rows each. Meant for right after the buffers are allocated, so that on NUMA machines their pages are
+    // spread over the nodes running the passes instead of all landing next to the thread that allocated them. Only a
+    // spread: tiles go to whichever worker asks next, so pages are not local to the thread that later renders them
+    void first_touch(Jobs::Scheduler &scheduler);
+
+    PassTimings const &get_last_timings() const
+    {
+        return last_timings;
+    }
+
+    void set_shading_mode(ShadingMode mode)
+    {
+        shading_mode = mode;
+    }
+
+    ShadingMode get_shading_mode() const
+    {
+        return shading_mode;
+    }
+
+    // The background, if any, is read until EndFrame
+    void set_clear(ClearMode mode, ClearValues const &values)
+    {
+        clear_mode   = mode;
+        clear_values = values;
+    }
+
+    ClearMode get_clear_mode() const
+    {
+        return clear_mode;
+    }
+
+    void set_partition_type(PartitionType type)
+    {
+        partition_type = type;
+        partition();
+    }
+
+    PartitionType get_partition_type() const
+    {
+        return partition_type;
+    }
+
+    uint32_t get_partition_count() const
+    {
+        return no_of_partitions;
+    }
+
+    std::span<PassTimings const> get_partition_timings() const
+    {
+        return {partition_timings, no_of_partitions};
+    }
+
+    // Counters of the last frame's main pass, valid once EndFrame returns
+    PipelineStatistics const &get_pipeline_statistics(uint32_t partition) const
+    {
+        assert(partition < no_of_partitions);
+        return statistics[partition];
+    }
+
+    PipelineStatistics get_pipeline_statistics() const;
+
+    // Transformed vertices of the renderable at index renderable in the list last passed to the pipeline
+    PostTransformVertex const *get_post_transformed(size_t renderable) const
+    {
+        assert(renderable < transforms.size());
+        return post_transform.data() + transforms[renderable].vertex_base;
+    }
+
+    // Frustum culling results of the renderable at index renderable for the current frame
+    bool is_visible(size_t renderable) const
+    {
+        assert(renderable < transforms.size());
+        return transforms[renderable].visible;
+    }
+
+    bool casts_shadow(size_t renderable) const
+    {
+        assert(renderable < transforms.size());
+        return transforms[renderable].casts_shadow;
+    }
+
+  private:
+    // Lays the boxes out for partition_type
+    void partition();
+    // Moves the strips of the adaptive partition from the busy times of the last shadow pass
+    void rebalance();
+    // One job per partition, jobs must hold no_of_partitions of them
+    void SubmitPass(Jobs::Scheduler &scheduler, Jobs::JobFuncPtr fn, ParallelThreadArgStruct *args, Jobs::Job *jobs,
+                    Jobs::Counter &counter, Jobs::Counter *after = nullptr);
+    // Rest of the frame once the bins are ready, runs as a job so that BeginFrame doesn't wait for anything
+    static void FrameTail(void *arg);
 };
 } // namespace Parallel
 
@@ -82,8 +555,8 @@ namespace ShadowMapper
 {
     // TODO:: Remove this split with if constexpr 
 using namespace Pipeline3D;
-void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2,
-                   MemAlloc<Pipeline3D::VertexAttrib3D> &allocator, int32_t XMinBound, int32_t XMaxBound);
+void Clip3D(VertexAttrib3D const &v0, VertexAttrib3D const &v1, VertexAttrib3D const &v2, int32_t XMinBound,
+            int32_t XMaxBound, int32_t YMinBound, int32_t YMaxBound);
 }
 
 // C++ is damn powerful/flexible.
@@ -3,8 +3,10 @@
 #include "../include/rasteriser.h"
 #include "../maths/vec.hpp"
 #include <array>
+#include <atomic>
 #include <barrier>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <iostream>
@@ -201,99 +203,6 @@ template <typename T, size_t N> class ThreadSafeQueue
     }
 };
 
-// so going with standard threads
-
-class ThreadPool
-{
-    std::atomic<bool> done          = true;
-    size_t            no_of_threads = 0;
-    // Since we don't have thread safe queue, we going to use std::queue along with a mutex
-    std::vector<std::thread> worker_threads;
-    constexpr static size_t  THREAD_POOL_QUEUE_SIZE = 25;
-
-  public:
-    // std::atomic<uint8_t> counter = 0;
-    // pointers to the rescue .. wonder what other languages use instead of pointer
-    std::latch *latch       = nullptr;
-    using ThreadPoolFuncPtr = void (*)(void *); // Function returning void and taking void ptr
-    struct ThreadPoolFunc
-    {
-        // Function to pointer
-        // void* arguments which will be back typecasted during each run
-        ThreadPoolFuncPtr fn;
-        void             *args; // Type erased argument to above function
-        void              operator()()
-        {
-            fn(args);
-        }
-    };
-    ThreadSafeQueue<ThreadPool::ThreadPoolFunc, THREAD_POOL_QUEUE_SIZE> task_queue{};
-
-    ThreadPool() noexcept : no_of_threads{std::thread::hardware_concurrency() - 2}
-    {
-        for (unsigned int i = 0; i < no_of_threads; ++i)
-            worker_threads.push_back(std::thread{&std::remove_reference_t<decltype(*this)>::worker_threads_func, this});
-    }
-    ThreadPool(unsigned int no_of_threads) noexcept : no_of_threads{no_of_threads}
-    {
-    }
-
-    void worker_threads_func()
-    {
-        while (done.load())
-        {
-            ThreadPoolFunc task;
-            if (task_queue.pop(task))
-            {
-                task();
-                // Signals that this thread's work has finished
-                latch->count_down();
-            }
-            /*else
-                std::this_thread::yield();*/
-        }
-    }
-
-    void add_task(ThreadPoolFunc const &task)
-    {
-        task_queue.push(task);
-    }
-    // Poor man's signal handling
-    uint8_t finished() const
-    {
-        // return counter.load();
-        return 0;
-    }
-    void wait_till_finished()
-    {
-        latch->wait();
-    }
-    void started(std::latch *wait_till)
-    {
-        // counter.store(0);
-        latch = wait_till;
-        task_queue.clear();
-    }
-
-    ~ThreadPool()
-    {
-        // wait until all task are zero
-        using namespace std::chrono;
-        while (task_queue.getsize() != 0)
-        {
-            std::this_thread::sleep_for(0.2s);
-        };
-        done.store(false);
-        for (auto &thread : worker_threads)
-        {
-            if (thread.joinable())
-                thread.join();
-        }
-    }
-
-  public:
-};
-
 // Implement parallel rendering using all the hardware concurrent threads for maximum performance along with SIMD
 // to boost up the fps really high
 
@@ -307,185 +216,169 @@ class ThreadPool
 
 // } // namespace Parallel
 
-template <typename T, size_t N> class StaticLockFreeQueue
+// Bounded multi producer multi consumer ring, after Dmitry Vyukov's queue
+// Every cell carries a sequence number telling whose turn it is : pos when free for the producer claiming pos,
+// pos + 1 once filled for the consumer claiming pos. Claims are a CAS on the position only, so neither side ever waits
+// on the other and a full or empty queue is seen without touching the data
+template <typename T, size_t N> class MPMCQueue
 {
-    T                   data[N];
-    std::atomic<size_t> head = 0;
-    std::atomic<size_t> tail = 0;
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    constexpr static size_t mask = N - 1;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   data;
+    };
+
+    // Producers and consumers each hammer their own position, both kept off the line of the other and of the cells
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+    alignas(64) Cell cells[N];
 
   public:
-    StaticLockFreeQueue() = default;
+    MPMCQueue()
+    {
+        for (size_t i = 0; i < N; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
 
-    void push(T item)
+    MPMCQueue(MPMCQueue const &)            = delete;
+    MPMCQueue &operator=(MPMCQueue const &) = delete;
+
+    // False when full
+    bool push(T item)
     {
-        auto t = tail.load();
-        do
+        auto  pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
         {
-            data[t + 1] = std::move(item);
-        } while (!tail.compare_exchange_weak(t, t + 1));
+            cell      = &cells[pos & mask];
+            auto seq  = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // the consumer of the previous lap hasn't freed the cell yet
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+        cell->data = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
     }
 
-    bool pop(T const &ref)
+    // False when empty, or when the producer of the next item hasn't finished writing it
+    bool pop(T &item)
     {
-        // Lock free implementation
-        auto   h   = head.load();
-        size_t len = 0;
-        do
+        auto  pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
         {
-            len = h - tail.load();
-            if (!len)
+            cell      = &cells[pos & mask];
+            auto seq  = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
                 return false;
-            ref = data[h + 1];
-        } while (!head.compare_exchange_weak(h, h + 1));
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+        item = std::move(cell->data);
+        // Free for the producer one lap ahead
+        cell->sequence.store(pos + N, std::memory_order_release);
         return true;
     }
 
+    // Only a snapshot while other threads push or pop
     size_t size() const
     {
-        return (tail - head);
+        auto head = dequeue_pos.load(std::memory_order_relaxed);
+        auto tail = enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
     }
 
     bool empty() const
     {
-        return (tail - head) == 0;
+        return size() == 0;
     }
-    void clear()
+
+    constexpr static size_t capacity()
     {
-        head = tail = 0;
+        return N;
     }
 };
 
-// Another thread pool that doesn't need mutex based protection or lock free mechanism
-
-namespace Alternative
+// Bounded single producer single consumer ring
+// Each side keeps a copy of the other side's position and only reads the shared one when the copy says full or empty,
+// so in the steady state push and pop touch no line written by the other thread except the data
+template <typename T, size_t N> class SPSCQueue
 {
-class ThreadPool
-{
-    std::vector<std::thread> worker_threads;
-    std::atomic<bool>        done = true;
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    constexpr static size_t mask = N - 1;
 
+    alignas(64) std::atomic<size_t> head{0}; // consumer
+    size_t cached_tail = 0;
+    alignas(64) std::atomic<size_t> tail{0}; // producer
+    size_t cached_head = 0;
+    alignas(64) T data[N];
 
   public:
-    constexpr static size_t  N    = 6;
-    std::latch *latch       = nullptr;
-    using ThreadPoolFuncPtr = void (*)(void *); // Function returning void and taking void ptr
-    struct ThreadPoolFunc
-    {
-        // Function to pointer
-        // void* arguments which will be back typecasted during each run
-        ThreadPoolFuncPtr fn;
-        void             *args; // Type erased argument to above function
-        void              operator()()
-        {
-            fn(args);
-        }
-    };
+    SPSCQueue()                             = default;
+    SPSCQueue(SPSCQueue const &)            = delete;
+    SPSCQueue &operator=(SPSCQueue const &) = delete;
 
-    struct AlternativeTaskDesc
+    // Producer only, false when full
+    bool push(T item)
     {
-        std::atomic<bool> completed = true;
-        ThreadPoolFunc    task;
-        AlternativeTaskDesc() = default;
-        AlternativeTaskDesc(bool b, const ThreadPoolFunc &fn) : completed{b}, task{fn}
-        {
-        }
-        AlternativeTaskDesc(const AlternativeTaskDesc &lhs)
-        {
-            completed.store(lhs.completed.load());
-            task = lhs.task;
-        }
-        AlternativeTaskDesc &operator=(const AlternativeTaskDesc &lhs)
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == N)
         {
-            completed.store(lhs.completed.load());
-            task = lhs.task;
-            return *this;
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == N)
+                return false;
         }
-    };
-
-  private:
-    std::vector<AlternativeTaskDesc> Task1;
-    std::vector<AlternativeTaskDesc> Task2;
-
-  public:
-    // Since above vectors are guarranted to never resize, task_ptr is always valid
-    std::vector<AlternativeTaskDesc> *task_ptrActive;
-    std::vector<AlternativeTaskDesc> *task_ptrPassive;
-
-    ThreadPool() noexcept
-    {
-        Task1 = std::vector<AlternativeTaskDesc>(N, AlternativeTaskDesc{});
-        Task2 = std::vector<AlternativeTaskDesc>(N, AlternativeTaskDesc{});
-        task_ptrActive = &Task1;
-        task_ptrPassive = &Task2;
-        for (unsigned int i = 0; i < N; ++i)
-            worker_threads.push_back(std::thread{&std::remove_reference_t<decltype(*this)>::worker_threads_func, this});
-    }
-    ThreadPool(unsigned int no_of_threads) noexcept
-    {
+        data[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
     }
 
-    void worker_threads_func()
+    // Consumer only, false when empty
+    bool pop(T &item)
     {
-        while (done.load())
+        auto h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail)
         {
-            auto &current_pool = *task_ptrActive;
-            for (auto &work : current_pool)
-            {
-                if (!work.completed.exchange(true,std::memory_order_acquire))
-                {
-                    work.task();
-                    latch->count_down();
-                }
-            }
-            // std::this_thread::yield();
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
         }
+        item = std::move(data[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
     }
 
-    // void add_tasks(Parallel::ParallelRenderer::ParallelThreadArgStruct* argPtr, size_t length, ThreadPoolFuncPtr fn)
-    //{
-    //     //// Switch the pointer after here
-    //     //auto i = 0;
-    //     //for (auto& task : *task_ptrPassive)
-    //     //{
-    //     //    assert(i < length);
-    //     //    AlternativeTaskDesc desc;
-    //     //    desc.completed = false;
-    //     //    desc.task      = ThreadPoolFunc(fn, argPtr + i);
-    //     //    task           = desc;
-    //     //}
-    // }
-    //
-    std::vector<AlternativeTaskDesc> *get_passive_ptr()
-    {
-        return task_ptrPassive;
-    }
-    uint8_t finished() const
-    {
-        return 0;
-    }
-    void wait_till_finished()
+    size_t size() const
     {
-        latch->wait();
+        // head first, it never passes the tail read after it
+        auto h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
     }
-    void started(std::latch *wait_till)
+
+    bool empty() const
     {
-        // The swap here needn't be atomic since only active will be used for the time being by running threads
-        auto temp = task_ptrActive;
-        /*auto temp = task_ptrActive.exchange(task_ptrPassive);
-        task_ptrPassive.exchange(temp);*/
-        task_ptrActive  = task_ptrPassive;
-        task_ptrPassive = temp;
-        latch           = wait_till;
+        return size() == 0;
     }
 
-    ~ThreadPool()
+    constexpr static size_t capacity()
     {
-        done.store(false);
-        for (auto &thread : worker_threads)
-        {
-            if (thread.joinable())
-                thread.join();
-        }
+        return N;
     }
 };
-} // namespace Alternative
\ No newline at end of file